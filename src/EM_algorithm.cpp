@@ -2,6 +2,12 @@
 #include "KalmanFiltering.h"
 #include "helper.h"
 #include <stdio.h>
+#include <random>
+#include <cstdint>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // [[Rcpp::depends(RcppArmadillo)]]
 
@@ -9,51 +15,431 @@ using namespace arma;
 using namespace Rcpp;
 using namespace std;
 
-// [[Rcpp::export]]
-Rcpp::List Estep(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
-                    arma::mat A, arma::colvec F0, arma::mat P0) {
+// Sufficient statistics computed by the E-step
+struct EstepStats {
+  mat beta, gamma, delta, gamma1, gamma2, P0;
+  colvec F0;
+  double loglik;
+};
 
-  const unsigned int T = X.n_rows;
-  const unsigned int n = X.n_cols;
-  const unsigned int rp = A.n_rows;
+// Sufficient statistics from the smoothed states Fs, covariances Psmooth and lag-one covariances
+// Wsmooth. X0 is X with missing values set to 0.
+template <class Store>
+static void EstepStatsT(const mat& X0, const mat& Fs, const Store& Psmooth, const cube& Wsmooth, EstepStats& s) {
 
-  // Run Kalman filter and Smoother
-  List ks = KalmanFilterSmoother(X, C, Q, R, A, F0, P0);
-  double loglik = as<double>(ks["loglik"]);
-  mat Fs = as<mat>(ks["Fs"]);
-  cube Psmooth = array2cube(as<NumericVector>(ks["Ps"]));
-  cube Wsmooth = array2cube(as<NumericVector>(ks["PsTm"]));
+  const unsigned int T = X0.n_rows;
+  const unsigned int n = X0.n_cols;
+  const unsigned int rp = Fs.n_cols;
+  mat B;
 
   // Run computations and return all estimates
-  mat delta(n, rp); delta.zeros();
-  mat gamma(rp, rp); gamma.zeros();
-  mat beta(rp, rp); beta.zeros();
-
-  // For E-step purposes it is sufficient to set missing observations
-  // to being 0.
-  X(find_nonfinite(X)).zeros();
+  s.delta.zeros(n, rp);
+  s.gamma.zeros(rp, rp);
+  s.beta.zeros(rp, rp);
 
   for (unsigned int t=0; t<T; ++t) {
-    delta += X.row(t).t() * Fs.row(t);
-    gamma += Fs.row(t).t() * Fs.row(t) + Psmooth.slice(t);
+    s.delta += X0.row(t).t() * Fs.row(t);
+    s.gamma += Fs.row(t).t() * Fs.row(t) + getSlice(Psmooth, t, B);
     if (t > 0) {
-      beta += Fs.row(t).t() * Fs.row(t-1) + Wsmooth.slice(t);
+      s.beta += Fs.row(t).t() * Fs.row(t-1) + Wsmooth.slice(t);
     }
   }
 
-  mat gamma1 = gamma - Fs.row(T-1).t() * Fs.row(T-1) - Psmooth.slice(T-1);
-  mat gamma2 = gamma - Fs.row(0).t() * Fs.row(0) - Psmooth.slice(0);
-  colvec F1 = Fs.row(0).t();
-  mat P1 = Psmooth.slice(0);
+  s.gamma1 = s.gamma - Fs.row(T-1).t() * Fs.row(T-1) - getSlice(Psmooth, T-1, B);
+  s.gamma2 = s.gamma - Fs.row(0).t() * Fs.row(0) - getSlice(Psmooth, 0, B);
+  s.F0 = Fs.row(0).t();
+  s.P0 = getSlice(Psmooth, 0, B);
+}
+
+// E-step without calls into the R API
+template <class Store>
+static void EstepCoreT(const mat& X, const mat& X0, const mat& C, const mat& Q, const mat& R,
+                       const mat& A, const colvec& F0, const mat& P0, EstepStats& s) {
+
+  // Run Kalman filter and Smoother
+  mat Fs;
+  Store Psmooth;
+  cube Wsmooth;
+  s.loglik = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, Fs, Psmooth, Wsmooth);
+  EstepStatsT(X0, Fs, Psmooth, Wsmooth, s);
+}
+
+// single = true stores the covariance histories in single precision, packed = true in packed
+// symmetric form (which symmetrizes them). By default they are stored in full double cubes.
+// sqroot = true uses the square-root filter and smoother (with full double storage) instead.
+void EstepCore(const mat& X, const mat& X0, const mat& C, const mat& Q, const mat& R,
+               const mat& A, const colvec& F0, const mat& P0, EstepStats& s,
+               bool single = false, bool packed = false, bool sqroot = false) {
+  if(sqroot) {
+    mat Fs;
+    cube Psmooth, Wsmooth;
+    s.loglik = KalmanFilterSmootherSqrtCore(X, C, Q, R, A, F0, P0, Fs, Psmooth, Wsmooth);
+    EstepStatsT(X0, Fs, Psmooth, Wsmooth, s);
+  } else if(packed) {
+    if(single) EstepCoreT<fSymCube>(X, X0, C, Q, R, A, F0, P0, s);
+    else EstepCoreT<SymCube>(X, X0, C, Q, R, A, F0, P0, s);
+  } else {
+    if(single) EstepCoreT<fcube>(X, X0, C, Q, R, A, F0, P0, s);
+    else EstepCoreT<cube>(X, X0, C, Q, R, A, F0, P0, s);
+  }
+}
+
+// [[Rcpp::export]]
+Rcpp::List Estep(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                    arma::mat A, arma::colvec F0, arma::mat P0, bool single = false,
+                    bool packed = false, bool sqroot = false) {
 
-  return Rcpp::List::create(Rcpp::Named("beta") = beta,
-                            Rcpp::Named("gamma") = gamma,
-                            Rcpp::Named("delta") = delta,
-                            Rcpp::Named("gamma1") = gamma1,
-                            Rcpp::Named("gamma2") = gamma2,
-                            Rcpp::Named("F0") = F1,
-                            Rcpp::Named("P0") = P1,
-                            Rcpp::Named("loglik") = loglik);
+  // For E-step purposes it is sufficient to set missing observations
+  // to being 0.
+  mat X0 = X;
+  X0(find_nonfinite(X0)).zeros();
+
+  EstepStats s;
+  EstepCore(X, X0, C, Q, R, A, F0, P0, s, single, packed, sqroot);
+
+  return Rcpp::List::create(Rcpp::Named("beta") = s.beta,
+                            Rcpp::Named("gamma") = s.gamma,
+                            Rcpp::Named("delta") = s.delta,
+                            Rcpp::Named("gamma1") = s.gamma1,
+                            Rcpp::Named("gamma2") = s.gamma2,
+                            Rcpp::Named("F0") = s.F0,
+                            Rcpp::Named("P0") = s.P0,
+                            Rcpp::Named("loglik") = s.loglik);
                             // Rcpp::Named("Fs") = ks["Fs"]);
 }
 
+
+// M-step of Doz, Giannone and Reichlin (2012), the native counterpart of EMstepDGR()
+// in R/EMDGR.R: updates the system matrices in place.
+void MstepDGR(const EstepStats& s, const mat& cpX, int T, int r, int rQi, int rRi,
+              mat& A, mat& C, mat& Q, mat& R) {
+
+  const int n = C.n_rows;
+  mat betasr = s.beta.rows(0, r-1);
+
+  C.cols(0, r-1) = s.delta.cols(0, r-1) * pinv(s.gamma.submat(0, 0, r-1, r-1));
+  mat A_update = betasr * inv(s.gamma1);
+  A.rows(0, r-1) = A_update;
+  if(rQi) {
+    mat Qsr = (s.gamma2.submat(0, 0, r-1, r-1) - A_update * betasr.t()) / double(T-1);
+    Q.submat(0, 0, r-1, r-1) = rQi == 2 ? Qsr : mat(diagmat(Qsr));
+  } else Q.submat(0, 0, r-1, r-1) = eye(r, r);
+
+  if(rRi) {
+    R = (cpX - C * s.delta.t()) / double(T);
+    if(rRi == 2) R.elem(find(R < 1e-7)).fill(1e-7); else {
+      colvec RR = R.diag();
+      RR.elem(find(RR < 1e-7)).fill(1e-7);
+      R = diagmat(RR);
+    }
+  } else R = eye(n, n);
+}
+
+// Convergence test, mirrors em_converged() in R/utils.R
+inline bool EMconverged(double loglik, double previous_loglik, double threshold) {
+  if(std::isfinite(loglik) && std::isfinite(previous_loglik)) {
+    double delta_loglik = std::abs(loglik - previous_loglik);
+    double avg_loglik = (std::abs(loglik) + std::abs(previous_loglik) + datum::eps) / 2;
+    if(delta_loglik / avg_loglik < threshold) return true;
+  }
+  return false;
+}
+
+enum EMstatus { EM_CONVERGED = 0, EM_MAXITER = 1, EM_DOMINATED = 2, EM_FAILED = 3 };
+
+// Number of EM iterations between the comparisons of the starts in EMDGRmultistart()
+#define EM_ROUND 5
+
+// A single EM run: system matrices (updated in place), the path of log-likelihoods and the exit status
+struct EMfit {
+  mat A, C, Q, R, P0;
+  colvec F0;
+  std::vector<double> loglik;
+  int status;
+};
+
+// Runs the DGR EM iterations for one starting point, until convergence, max_iter or (if
+// until > 0) until iterations in total. The run resumes from the iterations already in
+// fit.loglik, so that it can be advanced in rounds.
+void EMDGRCore(const mat& X, const mat& X0, const mat& cpX, int T, int r, int rQi, int rRi,
+               int min_iter, int max_iter, double tol, bool single, bool packed, bool sqroot,
+               EMfit& fit, int until = -1) {
+
+  EstepStats s;
+  double loglik, previous_loglik = fit.loglik.empty() ? -datum::max : fit.loglik.back();
+  int num_iter = fit.loglik.size();
+  bool converged = false;
+  const int stop = until > 0 ? std::min(until, max_iter) : max_iter;
+  fit.status = EM_MAXITER;
+
+  while(num_iter < stop && !converged) {
+    EstepCore(X, X0, fit.C, fit.Q, fit.R, fit.A, fit.F0, fit.P0, s, single, packed, sqroot);
+    MstepDGR(s, cpX, T, r, rQi, rRi, fit.A, fit.C, fit.Q, fit.R);
+    fit.F0 = s.F0;
+    fit.P0 = s.P0;
+    loglik = s.loglik;
+
+    // Iterate at least min_iter times
+    converged = num_iter < min_iter ? false : EMconverged(loglik, previous_loglik, tol);
+    fit.loglik.push_back(loglik);
+    ++num_iter;
+    previous_loglik = loglik;
+  }
+  if(converged) fit.status = EM_CONVERGED;
+}
+
+// Initial state covariance as computed in DFM()
+inline mat initP0(const mat& A, const mat& Q) {
+  const int rp = A.n_rows;
+  return reshape(pinv(kron(A, A)) * vectorise(Q), rp, rp);
+}
+
+// Perturbs the factor loadings and transition matrix of a starting point, shrinking
+// the transition matrix if necessary to keep the factor VAR stationary.
+void perturbStart(EMfit& fit, int r, double perturb, std::mt19937_64& rng) {
+
+  std::normal_distribution<double> rnorm(0.0, 1.0);
+  mat Csr = fit.C.cols(0, r-1), Asr = fit.A.rows(0, r-1);
+  const double sdC = perturb * (stddev(vectorise(Csr)) + 1e-8),
+               sdA = perturb * (stddev(vectorise(Asr)) + 1e-8);
+
+  Csr.transform([&](double v) { return v + sdC * rnorm(rng); });
+  Asr.transform([&](double v) { return v + sdA * rnorm(rng); });
+  fit.C.cols(0, r-1) = Csr;
+  fit.A.rows(0, r-1) = Asr;
+
+  cx_vec eigval;
+  for(int i = 0; i < 50; ++i) {
+    if(!eig_gen(eigval, fit.A) || max(abs(eigval)) < 0.99) break;
+    fit.A.rows(0, r-1) *= 0.9;
+  }
+  fit.P0 = initP0(fit.A, fit.Q);
+}
+
+//' Multi-start EM algorithm of Doz, Giannone and Reichlin (2012)
+//' @param X Data matrix (T x n) with missing values
+//' @param C,Q,R,A,F0,P0 Initial system matrices (the PCA / VAR starting values)
+//' @param cpX Cross-product of the imputed data
+//' @param T,r,rQi,rRi As in DFM()
+//' @param min_iter,max_iter,tol EM iteration control
+//' @param nstart Number of starting points, the first is the unperturbed one
+//' @param perturb Scale of the perturbations relative to the dispersion of the starting values
+//' @param seed Seed for the perturbations
+//' @param nthreads Number of threads
+//' @param single Store the covariance histories of the E-step in single precision
+//' @param packed Store the covariance histories of the E-step in packed symmetric form
+//' @param sqroot Use the square-root filter and smoother in the E-step
+// [[Rcpp::export]]
+Rcpp::List EMDGRmultistart(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                           arma::mat A, arma::colvec F0, arma::mat P0,
+                           arma::mat cpX, int T, int r, int rQi, int rRi,
+                           int min_iter, int max_iter, double tol,
+                           int nstart, double perturb, int seed, int nthreads,
+                           bool single = false, bool packed = false, bool sqroot = false) {
+
+  mat X0 = X;
+  X0(find_nonfinite(X0)).zeros();
+
+  // Starting points are generated serially, so that they do not depend on the number of threads
+  std::vector<EMfit> fits(nstart);
+  for(int k = 0; k < nstart; ++k) {
+    EMfit& fit = fits[k];
+    fit.A = A; fit.C = C; fit.Q = Q; fit.R = R; fit.F0 = F0; fit.P0 = P0;
+    if(k > 0) {
+      std::mt19937_64 rng(uint64_t(seed) + k);
+      perturbStart(fit, r, perturb, rng);
+    }
+  }
+
+  // The starts are advanced in rounds of EM_ROUND iterations. After each round, a run is
+  // abandoned if it is clearly dominated by another run: i.e. it trails the best competing
+  // run by more than it could make up at its current rate of improvement within the remaining
+  // iterations. As all runs are compared at the same iteration count, the result does not
+  // depend on the number of threads or their timing.
+  std::vector<int> active(nstart);
+  for(int k = 0; k < nstart; ++k) {
+    fits[k].loglik.clear();
+    fits[k].status = EM_MAXITER;
+    active[k] = k;
+  }
+  for(int until = EM_ROUND; !active.empty(); until += EM_ROUND) {
+    const int na = active.size();
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+    for(int i = 0; i < na; ++i) {
+      EMfit& fit = fits[active[i]];
+      try {
+        EMDGRCore(X, X0, cpX, T, r, rQi, rRi, min_iter, max_iter, tol, single, packed, sqroot, fit, until);
+      } catch(...) {
+        fit.status = EM_FAILED;
+      }
+    }
+    std::vector<double> ll(nstart, -datum::inf);
+    for(int k = 0; k < nstart; ++k)
+      if(fits[k].status != EM_FAILED && fits[k].status != EM_DOMINATED && !fits[k].loglik.empty())
+        ll[k] = fits[k].loglik.back();
+    std::vector<int> next;
+    for(int i = 0; i < na; ++i) {
+      const int k = active[i];
+      EMfit& fit = fits[k];
+      const int num_iter = fit.loglik.size();
+      if(fit.status != EM_MAXITER || num_iter >= max_iter) continue;
+      if(num_iter > min_iter && num_iter > 1) {
+        double best = -datum::inf;
+        for(int j = 0; j < nstart; ++j) if(j != k && ll[j] > best) best = ll[j];
+        const double loglik = fit.loglik.back(),
+          gap = best - loglik, rate = std::max(loglik - fit.loglik[num_iter-2], 0.0);
+        if(gap > tol * std::abs(best) && gap > rate * double(max_iter - num_iter)) {
+          fit.status = EM_DOMINATED;
+          continue;
+        }
+      }
+      next.push_back(k);
+    }
+    active.swap(next);
+  }
+
+  int best = -1;
+  NumericVector final_loglik(nstart);
+  IntegerVector iter(nstart), status(nstart);
+  for(int k = 0; k < nstart; ++k) {
+    const EMfit& fit = fits[k];
+    status[k] = fit.status;
+    iter[k] = fit.loglik.size();
+    final_loglik[k] = fit.status == EM_FAILED || fit.loglik.empty() ? NA_REAL : fit.loglik.back();
+    if(fit.status != EM_FAILED && fit.status != EM_DOMINATED && !fit.loglik.empty() &&
+       (best < 0 || fit.loglik.back() > fits[best].loglik.back())) best = k;
+  }
+  if(best < 0) Rcpp::stop("EM algorithm failed for all starting points");
+
+  const EMfit& fit = fits[best];
+  return Rcpp::List::create(Rcpp::Named("A") = fit.A,
+                            Rcpp::Named("C") = fit.C,
+                            Rcpp::Named("Q") = fit.Q,
+                            Rcpp::Named("R") = fit.R,
+                            Rcpp::Named("F0") = fit.F0,
+                            Rcpp::Named("P0") = fit.P0,
+                            Rcpp::Named("loglik") = fit.loglik,
+                            Rcpp::Named("converged") = fit.status == EM_CONVERGED,
+                            Rcpp::Named("start") = best + 1,
+                            Rcpp::Named("starts") = Rcpp::List::create(
+                              Rcpp::Named("loglik") = final_loglik,
+                              Rcpp::Named("iter") = iter,
+                              Rcpp::Named("status") = status));
+}
+
+
+// Column variances ignoring non-finite values
+rowvec colvarsFinite(const mat& x) {
+  rowvec res(x.n_cols);
+  for(unsigned int j = 0; j < x.n_cols; ++j) {
+    colvec xj = x.col(j);
+    xj = xj.elem(find_finite(xj));
+    res[j] = xj.n_elem > 1 ? var(xj) : datum::nan;
+  }
+  return res;
+}
+
+// Covariance matrix using pairwise-complete observations, as cov(x, use = "pairwise.complete.obs")
+mat pwcovFinite(const mat& x) {
+  const unsigned int n = x.n_cols;
+  mat res(n, n);
+  for(unsigned int i = 0; i < n; ++i) {
+    for(unsigned int j = i; j < n; ++j) {
+      uvec ok = find_finite(x.col(i) % x.col(j));
+      if(ok.n_elem < 2) {
+        res(i, j) = res(j, i) = datum::nan;
+        continue;
+      }
+      colvec xi = x.col(i), xj = x.col(j);
+      xi = xi.elem(ok);
+      xj = xj.elem(ok);
+      res(i, j) = res(j, i) = dot(xi - mean(xi), xj - mean(xj)) / double(ok.n_elem - 1);
+    }
+  }
+  return res;
+}
+
+// Initial system matrices from PCA and a VAR(p) on the principal components, as in DFM().
+// v holds (at least r) right singular vectors of X_imp; missing values in X mark imputed cells.
+void DFMinit(const mat& X, const mat& X_imp, const mat& v, int r, int p, int rQi, int rRi, EMfit& fit) {
+
+  const int n = X_imp.n_cols, T = X_imp.n_rows, rp = r * p;
+  mat vr = v.cols(0, r-1);
+  mat F_pc = X_imp * vr;
+
+  // Observation equation
+  fit.C = join_rows(vr, mat(n, rp-r, fill::zeros));
+  if(rRi) {
+    mat res = X_imp - F_pc * vr.t();
+    res.elem(find_nonfinite(X)).fill(datum::nan);
+    fit.R = rRi == 2 ? pwcovFinite(res) : mat(diagmat(colvarsFinite(res)));
+  } else fit.R = eye(n, n);
+
+  // Transition equation: VAR(p) on the principal components
+  mat Y = F_pc.rows(p, T-1), Xl(T-p, rp);
+  for(int i = 1; i <= p; ++i) Xl.cols((i-1)*r, i*r-1) = F_pc.rows(p-i, T-i-1);
+  mat Avar = inv(Xl.t() * Xl) * Xl.t() * Y;
+  mat res = Y - Xl * Avar;
+  fit.A = join_cols(mat(Avar.t()), mat(eye(rp-r, rp)));
+  fit.Q.zeros(rp, rp);
+  switch(rQi) {
+    case 0: fit.Q.submat(0, 0, r-1, r-1) = eye(r, r); break;
+    case 1: fit.Q.submat(0, 0, r-1, r-1) = diagmat(var(res)); break;
+    default: fit.Q.submat(0, 0, r-1, r-1) = cov(res);
+  }
+
+  // Initial state and state covariance
+  fit.F0 = Xl.row(0).t();
+  fit.P0 = initP0(fit.A, fit.Q);
+}
+
+//' Estimate a grid of DFM's with the DGR EM algorithm
+//' @param X Standardized data matrix (T x n) with missing values
+//' @param X_imp Imputed version of X
+//' @param v Right singular vectors of X_imp (at least max(rs) columns)
+//' @param rs,ps Number of factors and lags of each grid cell
+//' @param T,rQi,rRi As in DFM()
+//' @param min_iter,max_iter,tol EM iteration control
+//' @param nthreads Number of threads
+// [[Rcpp::export]]
+Rcpp::List EMDGRgrid(arma::mat X, arma::mat X_imp, arma::mat v,
+                     Rcpp::IntegerVector rs, Rcpp::IntegerVector ps,
+                     int T, int rQi, int rRi, int min_iter, int max_iter, double tol,
+                     int nthreads) {
+
+  const int ncell = rs.size();
+  mat X0 = X_imp;
+  X0(find_nonfinite(X)).zeros();
+  const mat cpX = X0.t() * X0;
+  std::vector<int> r(rs.begin(), rs.end()), p(ps.begin(), ps.end());
+
+  std::vector<EMfit> fits(ncell);
+  std::vector<double> time(ncell);
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+  for(int k = 0; k < ncell; ++k) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      DFMinit(X, X_imp, v, r[k], p[k], rQi, rRi, fits[k]);
+      EMDGRCore(X, X0, cpX, T, r[k], rQi, rRi, min_iter, max_iter, tol, false, false, false, fits[k]);
+    } catch(...) {
+      fits[k].status = EM_FAILED;
+    }
+    time[k] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  NumericVector loglik(ncell);
+  IntegerVector iter(ncell);
+  LogicalVector converged(ncell);
+  for(int k = 0; k < ncell; ++k) {
+    const EMfit& fit = fits[k];
+    bool ok = fit.status != EM_FAILED && !fit.loglik.empty();
+    loglik[k] = ok ? fit.loglik.back() : NA_REAL;
+    iter[k] = ok ? fit.loglik.size() : NA_INTEGER;
+    converged[k] = ok ? fit.status == EM_CONVERGED : NA_LOGICAL;
+  }
+
+  return Rcpp::List::create(Rcpp::Named("loglik") = loglik,
+                            Rcpp::Named("iter") = iter,
+                            Rcpp::Named("converged") = converged,
+                            Rcpp::Named("time") = time);
+}
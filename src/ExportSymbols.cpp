@@ -1,19 +1,85 @@
 #include <Rcpp.h>
 
 RcppExport SEXP _DFM_KalmanFilter(SEXP ySEXP, SEXP HSEXP, SEXP QSEXP, SEXP RSEXP, SEXP FsEXP, SEXP F0SEXP, SEXP P0SEXP);
-RcppExport SEXP _DFM_KalmanSmoother(SEXP FsEXP, SEXP HSEXP, SEXP RSEXP, SEXP FfTSEXP, SEXP FpTSEXP, SEXP PfT_vSEXP, SEXP PpT_vSEXP);
-RcppExport SEXP _DFM_KalmanFilterSmoother(SEXP ySEXP, SEXP HSEXP, SEXP QSEXP, SEXP RSEXP, SEXP FsEXP, SEXP F0SEXP, SEXP P0SEXP);
-RcppExport SEXP _DFM_Estep(SEXP ySEXP, SEXP HSEXP, SEXP QSEXP, SEXP RSEXP, SEXP FsEXP, SEXP F0SEXP, SEXP P0SEXP);
+RcppExport SEXP _DFM_KalmanSmoother(SEXP FsEXP, SEXP HSEXP, SEXP RSEXP, SEXP FfTSEXP, SEXP FpTSEXP, SEXP PfT_vSEXP, SEXP PpT_vSEXP, SEXP rangeSEXP);
+RcppExport SEXP _DFM_KalmanFilterSmoother(SEXP ySEXP, SEXP HSEXP, SEXP QSEXP, SEXP RSEXP, SEXP FsEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP rangeSEXP, SEXP packedSEXP, SEXP singleSEXP, SEXP checkSEXP);
+RcppExport SEXP _DFM_Estep(SEXP ySEXP, SEXP HSEXP, SEXP QSEXP, SEXP RSEXP, SEXP FsEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP singleSEXP, SEXP packedSEXP, SEXP sqrootSEXP);
 RcppExport SEXP _DFM_ainv(SEXP FsEXP);
 RcppExport SEXP _DFM_apinv(SEXP FsEXP);
+RcppExport SEXP _DFM_EMDGRmultistart(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP cpXSEXP, SEXP TSEXP, SEXP rSEXP, SEXP rQiSEXP, SEXP rRiSEXP, SEXP min_iterSEXP, SEXP max_iterSEXP, SEXP tolSEXP, SEXP nstartSEXP, SEXP perturbSEXP, SEXP seedSEXP, SEXP nthreadsSEXP, SEXP singleSEXP, SEXP packedSEXP, SEXP sqrootSEXP);
+RcppExport SEXP _DFM_EMDGRgrid(SEXP XSEXP, SEXP X_impSEXP, SEXP vSEXP, SEXP rsSEXP, SEXP psSEXP, SEXP TSEXP, SEXP rQiSEXP, SEXP rRiSEXP, SEXP min_iterSEXP, SEXP max_iterSEXP, SEXP tolSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_ICrBatch(SEXP panelsSEXP, SEXP rmaxSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_arsvd(SEXP xSEXP, SEXP kSEXP, SEXP oversampleSEXP, SEXP powerSEXP, SEXP seedSEXP);
+RcppExport SEXP _DFM_impNA_EMPCA(SEXP XSEXP, SEXP rSEXP, SEXP maxitSEXP, SEXP tolSEXP);
+RcppExport SEXP _DFM_impNA_median(SEXP XSEXP, SEXP WSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_impNA_MA(SEXP XSEXP, SEXP WSEXP, SEXP kSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_impNA_spline(SEXP XSEXP, SEXP WSEXP, SEXP kSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_prepNA(SEXP XSEXP, SEXP max_missingSEXP, SEXP scaleSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_unpackNA(SEXP MSEXP);
+RcppExport SEXP _DFM_maskRows(SEXP MSEXP, SEXP rmSEXP);
+RcppExport SEXP _DFM_setNA(SEXP XSEXP, SEXP MSEXP, SEXP valueSEXP);
+RcppExport SEXP _DFM_companionPowers(SEXP ASEXP, SEXP hSEXP);
+RcppExport SEXP _DFM_DFMforecast(SEXP ApowSEXP, SEXP CSEXP, SEXP FSEXP, SEXP hSEXP);
+RcppExport SEXP _DFM_DFMforecastVar(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP PSEXP, SEXP hSEXP, SEXP fullSEXP);
+RcppExport SEXP _DFM_DFMsimulate(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP FSEXP, SEXP PSEXP, SEXP hSEXP, SEXP NSEXP, SEXP centerSEXP, SEXP scaleSEXP, SEXP probsSEXP, SEXP VASEXP, SEXP VCSEXP, SEXP seedSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_DFMscenarioBatch(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP FSEXP, SEXP PSEXP, SEXP XSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_DFMedge(SEXP XSEXP, SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP F0SEXP, SEXP P0SEXP);
+RcppExport SEXP _DFM_DFMnewsCore(SEXP XoSEXP, SEXP XnSEXP, SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP edgeSEXP, SEXP targetSEXP, SEXP t_targetSEXP);
+RcppExport SEXP _DFM_KalmanState(SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP nrewindSEXP, SEXP lagSEXP);
+RcppExport SEXP _DFM_KalmanStateUpdate(SEXP stateSEXP, SEXP XSEXP);
+RcppExport SEXP _DFM_KalmanStateRewind(SEXP stateSEXP, SEXP kSEXP);
+RcppExport SEXP _DFM_KalmanStateInfo(SEXP stateSEXP);
+RcppExport SEXP _DFM_KalmanStateAbsorb(SEXP stateSEXP, SEXP iSEXP, SEXP xSEXP);
+RcppExport SEXP _DFM_KalmanStateClose(SEXP stateSEXP);
+RcppExport SEXP _DFM_KalmanFixedLag(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP LSEXP);
+RcppExport SEXP _DFM_KalmanStateSmooth(SEXP stateSEXP);
+RcppExport SEXP _DFM_KalmanCheckpointSmoother(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP memSEXP, SEXP kSEXP);
+RcppExport SEXP _DFM_KalmanFilterSmootherMapped(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP dirSEXP, SEXP keepSEXP);
+RcppExport SEXP _DFM_KalmanFilterSmootherSqrt(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP);
+RcppExport SEXP _DFM_KalmanFilterBatch(SEXP modelsSEXP, SEXP nthreadsSEXP);
+RcppExport SEXP _DFM_KalmanFilterKernel(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP kernelSEXP);
+RcppExport SEXP _DFM_KalmanKernelInfo();
 
 static const R_CallMethodDef CallEntries[] = {
   {"Cpp_KalmanFilter",   (DL_FUNC) &_DFM_KalmanFilter,   7},
-  {"Cpp_KalmanSmoother", (DL_FUNC) &_DFM_KalmanSmoother, 7},
-  {"Cpp_KalmanFilterSmoother", (DL_FUNC) &_DFM_KalmanFilterSmoother, 7},
-  {"Cpp_Estep",          (DL_FUNC) &_DFM_Estep,          7},
+  {"Cpp_KalmanSmoother", (DL_FUNC) &_DFM_KalmanSmoother, 8},
+  {"Cpp_KalmanFilterSmoother", (DL_FUNC) &_DFM_KalmanFilterSmoother, 11},
+  {"Cpp_Estep",          (DL_FUNC) &_DFM_Estep,          10},
   {"Cpp_ainv",        (DL_FUNC) &_DFM_ainv,        1},
   {"Cpp_apinv",       (DL_FUNC) &_DFM_apinv,       1},
+  {"Cpp_EMDGRmultistart", (DL_FUNC) &_DFM_EMDGRmultistart, 22},
+  {"Cpp_EMDGRgrid", (DL_FUNC) &_DFM_EMDGRgrid, 12},
+  {"Cpp_ICrBatch", (DL_FUNC) &_DFM_ICrBatch, 3},
+  {"Cpp_arsvd", (DL_FUNC) &_DFM_arsvd, 5},
+  {"Cpp_impNA_EMPCA", (DL_FUNC) &_DFM_impNA_EMPCA, 4},
+  {"Cpp_impNA_median", (DL_FUNC) &_DFM_impNA_median, 3},
+  {"Cpp_impNA_MA", (DL_FUNC) &_DFM_impNA_MA, 4},
+  {"Cpp_impNA_spline", (DL_FUNC) &_DFM_impNA_spline, 4},
+  {"Cpp_prepNA", (DL_FUNC) &_DFM_prepNA, 4},
+  {"Cpp_unpackNA", (DL_FUNC) &_DFM_unpackNA, 1},
+  {"Cpp_maskRows", (DL_FUNC) &_DFM_maskRows, 2},
+  {"Cpp_setNA", (DL_FUNC) &_DFM_setNA, 3},
+  {"Cpp_companionPowers", (DL_FUNC) &_DFM_companionPowers, 2},
+  {"Cpp_DFMforecast", (DL_FUNC) &_DFM_DFMforecast, 4},
+  {"Cpp_DFMforecastVar", (DL_FUNC) &_DFM_DFMforecastVar, 7},
+  {"Cpp_DFMsimulate", (DL_FUNC) &_DFM_DFMsimulate, 15},
+  {"Cpp_DFMscenarioBatch", (DL_FUNC) &_DFM_DFMscenarioBatch, 8},
+  {"Cpp_DFMedge", (DL_FUNC) &_DFM_DFMedge, 7},
+  {"Cpp_DFMnewsCore", (DL_FUNC) &_DFM_DFMnewsCore, 9},
+  {"Cpp_KalmanState", (DL_FUNC) &_DFM_KalmanState, 8},
+  {"Cpp_KalmanStateUpdate", (DL_FUNC) &_DFM_KalmanStateUpdate, 2},
+  {"Cpp_KalmanStateRewind", (DL_FUNC) &_DFM_KalmanStateRewind, 2},
+  {"Cpp_KalmanStateInfo", (DL_FUNC) &_DFM_KalmanStateInfo, 1},
+  {"Cpp_KalmanStateAbsorb", (DL_FUNC) &_DFM_KalmanStateAbsorb, 3},
+  {"Cpp_KalmanStateClose", (DL_FUNC) &_DFM_KalmanStateClose, 1},
+  {"Cpp_KalmanFixedLag", (DL_FUNC) &_DFM_KalmanFixedLag, 8},
+  {"Cpp_KalmanStateSmooth", (DL_FUNC) &_DFM_KalmanStateSmooth, 1},
+  {"Cpp_KalmanCheckpointSmoother", (DL_FUNC) &_DFM_KalmanCheckpointSmoother, 9},
+  {"Cpp_KalmanFilterSmootherMapped", (DL_FUNC) &_DFM_KalmanFilterSmootherMapped, 9},
+  {"Cpp_KalmanFilterSmootherSqrt", (DL_FUNC) &_DFM_KalmanFilterSmootherSqrt, 7},
+  {"Cpp_KalmanFilterBatch", (DL_FUNC) &_DFM_KalmanFilterBatch, 2},
+  {"Cpp_KalmanFilterKernel", (DL_FUNC) &_DFM_KalmanFilterKernel, 8},
+  {"Cpp_KalmanKernelInfo", (DL_FUNC) &_DFM_KalmanKernelInfo, 0},
   {NULL, NULL, 0}
 };
 
@@ -0,0 +1,109 @@
+#include <RcppArmadillo.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// [[Rcpp::depends(RcppArmadillo)]]
+using namespace arma;
+
+
+// Leading eigenvalues of X'X (= squared singular values of X) from the smaller Gram matrix.
+// These are computed exactly also on large panels: the Onatski criteria use the eigenvalues
+// rmax+1, ..., rmax+5 in the flat part of the spectrum, which a randomized SVD underestimates.
+colvec leadingEigenvalues(const mat& X, int k) {
+  colvec eigval = X.n_rows < X.n_cols ? eig_sym(X * X.t()) : eig_sym(X.t() * X);
+  eigval = flipud(eigval); // descending
+  return eigval.head(std::min(k, int(eigval.n_elem)));
+}
+
+// Edge distribution estimator of Onatski (2010) from descending eigenvalues,
+// using the calibration of the threshold delta by regression on the subsequent 5 eigenvalues.
+int onatskiED(const colvec& ev, int rmax) {
+  int r = 0, j = rmax + 1;
+  if(int(ev.n_elem) < rmax + 5) return NA_INTEGER;
+  for(int it = 0; it < 10; ++it) {
+    colvec y = ev.subvec(j-1, j+3), x(5);
+    for(int i = 0; i < 5; ++i) x[i] = std::pow(double(j + i - 1), 2.0/3.0);
+    double xm = mean(x), beta = dot(x - xm, y - mean(y)) / dot(x - xm, x - xm),
+           delta = 2 * std::abs(beta);
+    int rnew = 0;
+    for(int i = rmax; i >= 1; --i) {
+      if(ev[i-1] - ev[i] >= delta) {
+        rnew = i;
+        break;
+      }
+    }
+    if(it > 0 && rnew == r) break;
+    r = rnew;
+    j = r + 1;
+  }
+  return r;
+}
+
+struct ICres {
+  mat IC;
+  colvec ER, ev;
+  int r[5];
+};
+
+// Bai & Ng (2002) IC_p1 - IC_p3, eigenvalue ratios and the Onatski (2010) estimator for r = 0, ..., rmax
+void ICrCore(const mat& X, int rmax, ICres& res) {
+
+  const double T = X.n_rows, n = X.n_cols, nT = n * T, C2 = std::min(n, T);
+  res.ev = leadingEigenvalues(X, rmax + 5);
+  const int K = res.ev.n_elem;
+  double ssr = accu(square(X));
+
+  // Information criteria: V(k) is the average squared residual from k principal components
+  res.IC.set_size(rmax + 1, 3);
+  for(int k = 0; k <= rmax; ++k) {
+    if(k > 0) ssr -= k <= K ? res.ev[k-1] : 0;
+    double lV = std::log(std::max(ssr, 0.0) / nT);
+    res.IC(k, 0) = lV + k * (n + T) / nT * std::log(nT / (n + T));
+    res.IC(k, 1) = lV + k * (n + T) / nT * std::log(C2);
+    res.IC(k, 2) = lV + k * std::log(C2) / C2;
+  }
+
+  // Eigenvalue ratios lambda_k / lambda_k+1
+  res.ER.set_size(rmax);
+  for(int k = 1; k <= rmax; ++k) res.ER[k-1] = k < K ? res.ev[k-1] / res.ev[k] : datum::nan;
+
+  for(int i = 0; i < 3; ++i) res.r[i] = res.IC.col(i).index_min();
+  res.r[3] = res.ER.is_finite() ? int(res.ER.index_max()) + 1 : NA_INTEGER;
+  res.r[4] = onatskiED(res.ev, rmax);
+}
+
+//' Information criteria for the number of factors in a list of panels
+//' @param panels List of standardized matrices without missing values
+//' @param rmax Maximum number of factors
+//' @param nthreads Number of threads
+// [[Rcpp::export]]
+Rcpp::List ICrBatch(Rcpp::List panels, int rmax, int nthreads) {
+
+  const int np = panels.size();
+  std::vector<mat> X(np);
+  for(int i = 0; i < np; ++i) X[i] = Rcpp::as<mat>(panels[i]);
+
+  std::vector<ICres> res(np);
+  std::vector<int> failed(np, 0);
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+  for(int i = 0; i < np; ++i) {
+    try {
+      ICrCore(X[i], rmax, res[i]);
+    } catch(...) {
+      failed[i] = 1;
+    }
+  }
+
+  Rcpp::List out(np);
+  for(int i = 0; i < np; ++i) {
+    if(failed[i]) Rcpp::stop("Eigendecomposition failed for panel %d", i + 1);
+    Rcpp::IntegerVector r(res[i].r, res[i].r + 5);
+    r.attr("names") = Rcpp::CharacterVector::create("IC_p1", "IC_p2", "IC_p3", "ER", "ED");
+    out[i] = Rcpp::List::create(Rcpp::Named("r") = r,
+                                Rcpp::Named("IC") = res[i].IC,
+                                Rcpp::Named("ER") = res[i].ER,
+                                Rcpp::Named("eigenvalues") = res[i].ev);
+  }
+  return out;
+}
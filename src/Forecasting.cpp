@@ -0,0 +1,606 @@
+#include <RcppArmadillo.h>
+#include <cstdint>
+#include <algorithm>
+#include "KalmanFiltering.h"
+
+// [[Rcpp::depends(RcppArmadillo)]]
+using namespace arma;
+
+
+// Stacked state (f_T, f_{T-1}, ..., f_{T-p+1}) from the last p rows of the T x r factor matrix F
+static colvec stackedState(const mat& F, uword p) {
+  const uword r = F.n_cols, T = F.n_rows;
+  colvec s(r * p);
+  for (uword k = 0; k < p; ++k) s.subvec(k * r, (k + 1) * r - 1) = F.row(T - 1 - k).t();
+  return s;
+}
+
+// Companion (state space) form of the model from the r x rp VAR coefficients A,
+// the r x r factor innovation covariance Q and the n x r observation matrix C
+static void companionForm(const mat& A, const mat& Q, const mat& C, mat& Ac, mat& Qc, mat& Cc) {
+  const uword r = A.n_rows, rp = A.n_cols, q = rp - r;
+  Ac.zeros(rp, rp);
+  Qc.zeros(rp, rp);
+  Cc.zeros(C.n_rows, rp);
+  Ac.rows(0, r - 1) = A;
+  if (q) Ac.submat(r, 0, rp - 1, q - 1).eye();
+  Qc.submat(0, 0, r - 1, r - 1) = Q;
+  Cc.cols(0, r - 1) = C;
+}
+
+//' Top blocks of the powers of the companion matrix of a VAR(p)
+//' @param A r x rp matrix of VAR coefficients (the top block of the companion matrix)
+//' @param h Number of powers
+//' @return (h*r) x rp matrix stacking the first r rows of the companion matrix raised to the powers 1, ..., h
+// [[Rcpp::export]]
+arma::mat companionPowers(const arma::mat& A, int h) {
+  const uword r = A.n_rows, rp = A.n_cols;
+  mat Apow(h * r, rp);
+  if (h < 1) return Apow;
+  Apow.rows(0, r - 1) = A;
+  // B_{i+1} = B_i Acomp = B_i[, 1:r] A + [B_i[, (r+1):rp], 0], only the top block is needed
+  for (int i = 1; i < h; ++i) {
+    const mat B = Apow.rows((i - 1) * r, i * r - 1);
+    mat Bn = B.cols(0, r - 1) * A;
+    if (rp > r) Bn.cols(0, rp - r - 1) += B.cols(r, rp - 1);
+    Apow.rows(i * r, (i + 1) * r - 1) = Bn;
+  }
+  return Apow;
+}
+
+//' h-step ahead forecasts of the factors and data from the stacked state
+//' @param Apow Stacked companion matrix powers returned by companionPowers() with at least h*r rows
+//' @param C n x r observation matrix
+//' @param F T x r matrix of factor estimates (the last p rows form the state)
+//' @param h Forecast horizon
+// [[Rcpp::export]]
+Rcpp::List DFMforecast(const arma::mat& Apow, const arma::mat& C, const arma::mat& F, int h) {
+  const uword r = F.n_cols, rp = Apow.n_cols, p = rp / r, T = F.n_rows;
+  if (h < 1) return Rcpp::List::create(Rcpp::Named("F_fcst") = mat(0, r), Rcpp::Named("X_fcst") = mat(0, C.n_rows));
+  if (Apow.n_rows < (uword)h * r) Rcpp::stop("Apow contains fewer than h powers");
+  if (T < p) Rcpp::stop("Fewer observations than lags");
+
+  const colvec s = stackedState(F, p);
+
+  // All horizons in one multiply, then map to the data
+  mat F_fc = reshape(Apow.rows(0, h * r - 1) * s, r, h).t();
+  mat X_fc = F_fc * C.t();
+
+  return Rcpp::List::create(Rcpp::Named("F_fcst") = F_fc,
+                            Rcpp::Named("X_fcst") = X_fc);
+}
+
+//' Forecast error variances of the factors and data
+//' @param A r x rp matrix of VAR coefficients
+//' @param Q r x r factor innovation covariance
+//' @param C n x r observation matrix
+//' @param R n x n observation error covariance
+//' @param P rp x rp covariance of the terminal stacked state (filtered at time T)
+//' @param h Forecast horizon
+//' @param full Logical. Also return the full covariance matrices for each horizon?
+// [[Rcpp::export]]
+Rcpp::List DFMforecastVar(const arma::mat& A, const arma::mat& Q, const arma::mat& C,
+                          const arma::mat& R, arma::mat P, int h, bool full = false) {
+  const uword r = A.n_rows, rp = A.n_cols, n = C.n_rows, q = rp - r;
+  mat F_var(h, r), X_var(h, n);
+  cube F_cov, X_cov;
+  if (full) {
+    F_cov.set_size(r, r, h);
+    X_cov.set_size(n, n, h);
+  }
+  const rowvec dR = diagvec(R).t();
+  mat AP(r, rp), Pn(rp, rp);
+
+  for (int i = 0; i < h; ++i) {
+    // P <- Acomp P Acomp' + Qcomp, using the structure of the companion matrix: O(r rp^2)
+    AP = A * P;
+    Pn.submat(0, 0, r - 1, r - 1) = AP * A.t() + Q;
+    if (q) {
+      Pn.submat(0, r, r - 1, rp - 1) = AP.cols(0, q - 1);
+      Pn.submat(r, 0, rp - 1, r - 1) = AP.cols(0, q - 1).t();
+      Pn.submat(r, r, rp - 1, rp - 1) = P.submat(0, 0, q - 1, q - 1);
+    }
+    P = Pn;
+    const mat Pf = symmatu(P.submat(0, 0, r - 1, r - 1));
+    F_var.row(i) = diagvec(Pf).t();
+    const mat CP = C * Pf;
+    X_var.row(i) = sum(CP % C, 1).t() + dR;
+    if (full) {
+      F_cov.slice(i) = Pf;
+      X_cov.slice(i) = CP * C.t() + R;
+    }
+  }
+
+  Rcpp::List res = Rcpp::List::create(Rcpp::Named("F_var") = F_var,
+                                      Rcpp::Named("X_var") = X_var);
+  if (full) {
+    res["F_cov"] = F_cov;
+    res["X_cov"] = X_cov;
+  }
+  return res;
+}
+
+// xoshiro256** generator (Blackman and Vigna, 2021), seeded with splitmix64 from a global seed and a stream
+// number, so that each simulated path has its own reproducible stream independent of the thread count.
+// Each stream takes its four state words from its own four splitmix64 outputs, so no two streams share
+// state words.
+struct Xoshiro256 {
+  uint64_t s[4];
+  bool has_spare;
+  double spare;
+  Xoshiro256(uint64_t seed, uint64_t stream) : has_spare(false), spare(0) {
+    uint64_t x = seed + 0x9E3779B97F4A7C15ULL * 4 * stream;
+    for (int i = 0; i < 4; ++i) {
+      uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      s[i] = z ^ (z >> 31);
+    }
+  }
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+  uint64_t next() {
+    const uint64_t res = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return res;
+  }
+  // Uniform on (0, 1]
+  double unif() { return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0); }
+  // Standard normal (Box-Muller)
+  double norm() {
+    if (has_spare) {
+      has_spare = false;
+      return spare;
+    }
+    const double rad = std::sqrt(-2.0 * std::log(unif())), ang = 2.0 * M_PI * unif();
+    spare = rad * std::sin(ang);
+    has_spare = true;
+    return rad * std::cos(ang);
+  }
+  void fill(double* z, uword k) { for (uword i = 0; i < k; ++i) z[i] = norm(); }
+};
+
+// Symmetric square root factor L (L L' = S) of a positive semi-definite matrix
+static mat sqrtPSD(const mat& S) {
+  vec ev;
+  mat V;
+  eig_sym(ev, V, symmatu(S));
+  ev.clamp(0, datum::inf);
+  return V * diagmat(sqrt(ev));
+}
+
+// Quantile of x[0:N-1] for probability p (type 7 as in stats::quantile), reorders x
+static double quantile7(double* x, int N, double p) {
+  const double h = (N - 1) * p;
+  const int lo = std::floor(h);
+  std::nth_element(x, x + lo, x + N);
+  double q = x[lo];
+  if (h > lo) q += (h - lo) * (*std::min_element(x + lo + 1, x + N) - q);
+  return q;
+}
+
+// Spectral radius of the companion matrix of the r x rp VAR coefficients A (infinite if it cannot be computed)
+static double spectralRadius(const mat& A) {
+  const uword r = A.n_rows, rp = A.n_cols;
+  mat Ac(rp, rp, fill::zeros);
+  Ac.rows(0, r - 1) = A;
+  if (rp > r) Ac.submat(r, 0, rp - 1, rp - r - 1).eye();
+  cx_vec ev;
+  if (!eig_gen(ev, Ac)) return datum::inf;
+  return max(abs(ev));
+}
+
+//' Monte Carlo simulation of forecast paths
+//' @param A r x rp matrix of VAR coefficients
+//' @param Q r x r factor innovation covariance
+//' @param C n x r observation matrix
+//' @param R n x n observation error covariance
+//' @param F T x r matrix of factor estimates (the last p rows form the terminal state)
+//' @param P rp x rp covariance of the terminal stacked state
+//' @param h Forecast horizon
+//' @param N Number of paths
+//' @param center,scale Vectors of length n to unstandardize the simulated data (x * scale + center)
+//' @param probs Probabilities of quantiles to return instead of the paths (empty to return the paths)
+//' @param VA rp x rp matrix (Z'Z)^-1 of the VAR regressors, such that vec(A') ~ N(vec(A'), Q x VA), or empty to
+//' keep A and C fixed
+//' @param VC r x r x n array of the covariances of the rows of C (used if VA is not empty)
+//' @param seed Seed of the random number streams
+//' @param nthreads Number of threads
+//' @return h x n x N array of paths, or h x n x length(probs) array of quantiles
+// [[Rcpp::export]]
+Rcpp::NumericVector DFMsimulate(const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R,
+                                const arma::mat& F, const arma::mat& P, int h, int N,
+                                const arma::colvec& center, const arma::colvec& scale,
+                                const arma::colvec& probs, const arma::mat& VA, Rcpp::NumericVector VC,
+                                double seed, int nthreads = 1) {
+  const uword r = A.n_rows, rp = A.n_cols, p = rp / r, n = C.n_rows, T = F.n_rows, q = rp - r;
+  if (T < p) Rcpp::stop("Fewer observations than lags");
+  const bool quant = probs.n_elem > 0, diagR = R.is_diagmat(), pdraw = VA.n_elem > 0;
+  if (pdraw && (VA.n_rows != rp || VA.n_cols != rp || (uword)VC.size() != r * r * n))
+    Rcpp::stop("VA must be rp x rp and VC r x r x n");
+  const uint64_t sd = (uint64_t)seed;
+
+  const colvec sT = stackedState(F, p);
+  const mat LP = sqrtPSD(P), LQ = sqrtPSD(Q), LR = diagR ? mat() : sqrtPSD(R);
+  const colvec sdR = sqrt(clamp(diagvec(R), 0, datum::inf));
+
+  // Square roots of the covariances of the parameter estimates. Draws of A are redrawn (at most
+  // 100 times, else A is kept) if they are explosive while the estimate is not.
+  mat LA;
+  cube LC;
+  if (pdraw) {
+    LA = sqrtPSD(VA);
+    const cube VCc(VC.begin(), r, r, n, false, true);
+    LC.set_size(r, r, n);
+    for (uword j = 0; j < n; ++j) LC.slice(j) = sqrtPSD(VCc.slice(j));
+  }
+  const bool stable = pdraw && spectralRadius(A) < 1;
+  cube Cs(pdraw ? n : 0, pdraw ? r : 0, pdraw ? N : 0);
+
+  // Parameters (stream 3k) and factor paths (r x h x N, stream 3k+1) for path k
+  cube Fsim(r, h, N);
+  #pragma omp parallel for num_threads(nthreads) schedule(static)
+  for (int k = 0; k < N; ++k) {
+    mat Ak = A;
+    if (pdraw) {
+      Xoshiro256 prng(sd, 3 * (uint64_t)k);
+      colvec zc(r);
+      mat G(r, rp);
+      Cs.slice(k) = C;
+      for (uword j = 0; j < n; ++j) {
+        prng.fill(zc.memptr(), r);
+        Cs.slice(k).row(j) += (LC.slice(j) * zc).t();
+      }
+      for (int tries = 0; tries < 100; ++tries) {
+        prng.fill(G.memptr(), r * rp);
+        Ak = A + LQ * G * LA.t();
+        if (!stable || spectralRadius(Ak) < 1) break;
+        Ak = A;
+      }
+    }
+    Xoshiro256 rng(sd, 3 * (uint64_t)k + 1);
+    colvec z(rp), s(rp), f(r), e(r);
+    rng.fill(z.memptr(), rp);
+    s = sT + LP * z;
+    for (int i = 0; i < h; ++i) {
+      rng.fill(e.memptr(), r);
+      f = Ak * s + LQ * e;
+      if (q) s.subvec(r, rp - 1) = s.subvec(0, q - 1).eval();
+      s.subvec(0, r - 1) = f;
+      Fsim.slice(k).col(i) = f;
+    }
+  }
+
+  // Observations x = C f + e, e ~ N(0, R): stream 3k+2 for path k, drawing n values per horizon
+  std::vector<Xoshiro256> nrng;
+  nrng.reserve(N);
+  for (int k = 0; k < N; ++k) nrng.push_back(Xoshiro256(sd, 3 * (uint64_t)k + 2));
+  const int nq = probs.n_elem;
+  Rcpp::NumericVector res(quant ? (size_t)h * n * nq : (size_t)h * n * N);
+  double *pres = res.begin();
+  mat Xi(quant ? n : 0, quant ? N : 0); // one horizon of all paths when computing quantiles
+
+  for (int i = 0; i < (quant ? h : 1); ++i) {
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (int k = 0; k < N; ++k) {
+      const mat& Ck = pdraw ? Cs.slice(k) : C;
+      colvec z(n), x(n);
+      for (int ii = quant ? i : 0; ii < (quant ? i + 1 : h); ++ii) {
+        nrng[k].fill(z.memptr(), n);
+        x = Ck * Fsim.slice(k).col(ii) + (diagR ? colvec(sdR % z) : colvec(LR * z));
+        x = x % scale + center;
+        if (quant) Xi.col(k) = x;
+        else for (uword j = 0; j < n; ++j) pres[ii + (size_t)h * (j + n * (size_t)k)] = x[j];
+      }
+    }
+    if (quant) {
+      #pragma omp parallel num_threads(nthreads)
+      {
+        std::vector<double> buf(N);
+        #pragma omp for schedule(static)
+        for (int j = 0; j < (int)n; ++j) {
+          for (int k = 0; k < N; ++k) buf[k] = Xi(j, k);
+          for (int l = 0; l < nq; ++l) pres[i + (size_t)h * (j + n * (size_t)l)] = quantile7(buf.data(), N, probs[l]);
+        }
+      }
+    }
+  }
+
+  res.attr("dim") = Rcpp::IntegerVector::create(h, n, quant ? nq : N);
+  return res;
+}
+
+// Runs the Kalman filter over rows [t0, t1) of X, starting from the predicted state (fp, Pp) for
+// row t0 and leaving the predicted state for row t1 in (fp, Pp)
+static void filterAdvance(const mat& X, const mat& Ac, const mat& Cc, const mat& Qc, const mat& R,
+                          int t0, int t1, colvec& fp, mat& Pp) {
+  colvec ff;
+  mat Pf;
+  for (int t = t0; t < t1; ++t) {
+    KalmanFilterStep(X, t, Cc, R, fp, Pp, ff, Pf);
+    fp = Ac * ff;
+    Pp = Ac * Pf * Ac.t() + Qc;
+  }
+}
+
+// Kalman filter and (RTS) smoother over the rows of X, starting from the predicted state (fp0, Pp0) for the
+// first row. Returns the smoothed states (rp x L) and covariances, and the smoother gains J needed for
+// smoothed cross-covariances: Cov(F_t, F_s) = J_t ... J_{s-1} Ps_s for t < s. The gains use a pseudo-inverse,
+// so that singular predicted covariances (e.g. from a known terminal state) are handled. If loglik is supplied,
+// the log-likelihood of X is added to it.
+static void windowSmoother(const mat& X, const mat& Ac, const mat& Cc, const mat& Qc, const mat& R,
+                           const colvec& fp0, const mat& Pp0, mat& Fs, cube& Ps, cube& J,
+                           double* loglik = NULL) {
+  const int L = X.n_rows, rp = Ac.n_rows;
+  mat Fp(rp, L), Ff(rp, L);
+  cube Pp(rp, rp, L), Pf(rp, rp, L);
+  colvec fp = fp0, ff;
+  mat P = Pp0, Pft;
+  for (int t = 0; t < L; ++t) {
+    Fp.col(t) = fp;
+    Pp.slice(t) = P;
+    const double ll = KalmanFilterStep(X, t, Cc, R, fp, P, ff, Pft);
+    if (loglik != NULL) *loglik += ll;
+    Ff.col(t) = ff;
+    Pf.slice(t) = Pft;
+    fp = Ac * ff;
+    P = Ac * Pft * Ac.t() + Qc;
+  }
+  Fs.set_size(rp, L);
+  Ps.set_size(rp, rp, L);
+  J.zeros(rp, rp, L);
+  Fs.col(L - 1) = Ff.col(L - 1);
+  Ps.slice(L - 1) = Pf.slice(L - 1);
+  for (int t = L - 2; t >= 0; --t) {
+    J.slice(t) = Pf.slice(t) * Ac.t() * pinv(symmatu(Pp.slice(t + 1)));
+    Fs.col(t) = Ff.col(t) + J.slice(t) * (Fs.col(t + 1) - Fp.col(t + 1));
+    Ps.slice(t) = Pf.slice(t) + J.slice(t) * (Ps.slice(t + 1) - Pp.slice(t + 1)) * J.slice(t).t();
+  }
+}
+
+//' Conditional (scenario) forecasts
+//' @param A r x rp matrix of VAR coefficients
+//' @param Q r x r factor innovation covariance
+//' @param C n x r observation matrix
+//' @param R n x n observation error covariance
+//' @param F T x r matrix of factor estimates (the last p rows form the terminal state)
+//' @param P rp x rp covariance of the terminal stacked state
+//' @param X h x n x S array of scenarios: standardized values of the constrained cells, NA elsewhere
+//' @param nthreads Number of threads to process scenarios in parallel
+// [[Rcpp::export]]
+Rcpp::List DFMscenarioBatch(const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R,
+                            const arma::mat& F, const arma::mat& P, Rcpp::NumericVector X, int nthreads = 1) {
+  const uword r = A.n_rows, rp = A.n_cols, p = rp / r, n = C.n_rows, T = F.n_rows;
+  if (T < p) Rcpp::stop("Fewer observations than lags");
+  Rcpp::IntegerVector d = X.attr("dim");
+  const int h = d[0], S = d[2];
+  if ((uword)d[1] != n) Rcpp::stop("Scenarios must have one column per series");
+  const cube Xc(X.begin(), h, n, S, false, true);
+
+  // State space form in companion format
+  mat Ac, Qc, Cc;
+  companionForm(A, Q, C, Ac, Qc, Cc);
+
+  // Prediction for T+1 from the terminal state: initializes the filter over the scenario rows
+  const colvec sT = stackedState(F, p);
+  const colvec F0 = Ac * sT;
+  const mat P0 = Ac * P * Ac.t() + Qc;
+  const rowvec dR = diagvec(R).t();
+
+  cube F_fc(h, r, S), F_var(h, r, S), X_fc(h, n, S), X_var(h, n, S);
+  colvec loglik(S);
+  std::vector<int> failed(S, 0);
+
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+  for (int k = 0; k < S; ++k) {
+    try {
+      mat Fs;
+      cube Ps, J;
+      const mat Xk = Xc.slice(k);
+      double ll = 0;
+      windowSmoother(Xk, Ac, Cc, Qc, R, F0, P0, Fs, Ps, J, &ll);
+      loglik[k] = ll;
+      F_fc.slice(k) = Fs.rows(0, r - 1).t();
+      X_fc.slice(k) = F_fc.slice(k) * C.t();
+      for (int i = 0; i < h; ++i) {
+        const mat Pf = Ps.slice(i).submat(0, 0, r - 1, r - 1);
+        const mat CP = C * Pf;
+        F_var.slice(k).row(i) = diagvec(Pf).t();
+        X_var.slice(k).row(i) = sum(CP % C, 1).t() + dR;
+        // Constrained cells are known
+        for (uword j = 0; j < n; ++j) if (std::isfinite(Xk(i, j))) {
+          X_fc(i, j, k) = Xk(i, j);
+          X_var(i, j, k) = 0;
+        }
+      }
+    } catch (...) {
+      failed[k] = 1;
+      F_fc.slice(k).fill(datum::nan);
+      F_var.slice(k).fill(datum::nan);
+      X_fc.slice(k).fill(datum::nan);
+      X_var.slice(k).fill(datum::nan);
+      loglik[k] = datum::nan;
+    }
+  }
+  int nfail = 0;
+  for (int k = 0; k < S; ++k) nfail += failed[k];
+  if (nfail) Rcpp::warning("Kalman filter failed for %d scenario(s), returning NaN", nfail);
+
+  return Rcpp::List::create(Rcpp::Named("X_fcst") = X_fc,
+                            Rcpp::Named("X_var") = X_var,
+                            Rcpp::Named("F_fcst") = F_fc,
+                            Rcpp::Named("F_var") = F_var,
+                            Rcpp::Named("loglik") = loglik);
+}
+
+//' Kalman filter state at the ragged edge of the data
+//' @param X Standardized data matrix (T x n) used in estimation
+//' @param A r x rp matrix of VAR coefficients
+//' @param Q r x r factor innovation covariance
+//' @param C n x r observation matrix
+//' @param R n x n observation error covariance
+//' @param F0 rp x 1 initial (predicted) state for the first row
+//' @param P0 rp x rp initial (predicted) state covariance for the first row
+//' @return The number of rows t before the ragged edge (the first row after the last observation of any series),
+//' and the predicted state (F, P) for row t + 1, together with F0 and P0
+// [[Rcpp::export]]
+Rcpp::List DFMedge(const arma::mat& X, const arma::mat& A, const arma::mat& Q, const arma::mat& C,
+                   const arma::mat& R, const arma::colvec& F0, const arma::mat& P0) {
+  const int T = X.n_rows, n = X.n_cols;
+  int te = T;
+  for (int j = 0; j < n; ++j) {
+    int t = T - 1;
+    while (t >= 0 && !std::isfinite(X(t, j))) --t;
+    if (t >= 0 && t + 1 < te) te = t + 1;
+  }
+  mat Ac, Qc, Cc;
+  companionForm(A, Q, C, Ac, Qc, Cc);
+  colvec fp = F0;
+  mat Pp = P0;
+  filterAdvance(X, Ac, Cc, Qc, R, 0, te, fp, Pp);
+  return Rcpp::List::create(Rcpp::Named("t") = te,
+                            Rcpp::Named("F") = fp,
+                            Rcpp::Named("P") = Pp,
+                            Rcpp::Named("F0") = F0,
+                            Rcpp::Named("P0") = P0);
+}
+
+//' News decomposition of the update of a nowcast between two data vintages (Banbura and Modugno, 2014)
+//' @param Xo Old standardized data matrix (T x n), NA where not (yet) observed
+//' @param Xn New standardized data matrix (T x n)
+//' @param A r x rp matrix of VAR coefficients
+//' @param Q r x r factor innovation covariance
+//' @param C n x r observation matrix
+//' @param R n x n observation error covariance
+//' @param edge Filter state at the ragged edge of the old data returned by DFMedge()
+//' @param target Target series (0-based)
+//' @param t_target Target period (0-based, may be beyond the last row)
+// [[Rcpp::export]]
+Rcpp::List DFMnewsCore(const arma::mat& Xo, const arma::mat& Xn, const arma::mat& A, const arma::mat& Q,
+                       const arma::mat& C, const arma::mat& R, Rcpp::List edge, int target, int t_target) {
+  const int T = Xo.n_rows, n = Xo.n_cols, r = A.n_rows;
+  if ((int)Xn.n_rows != T || (int)Xn.n_cols != n) Rcpp::stop("Old and new data must have the same dimensions");
+  if (t_target < 0 || target < 0 || target >= n) Rcpp::stop("Invalid target series or period");
+  mat Ac, Qc, Cc;
+  companionForm(A, Q, C, Ac, Qc, Cc);
+
+  // First period with new or revised data
+  int t0 = T;
+  for (int t = 0; t < T && t0 == T; ++t) for (int j = 0; j < n; ++j) {
+    const double o = Xo(t, j), nw = Xn(t, j);
+    if (std::isfinite(o) != std::isfinite(nw) || (std::isfinite(o) && o != nw)) {
+      t0 = t;
+      break;
+    }
+  }
+
+  // Window [ws, Tend): start from the edge state if possible, otherwise filter the old data up to ws
+  const int ws = std::min(t0, t_target), Tend = std::max(T, t_target + 1), L = Tend - ws;
+  const int te = Rcpp::as<int>(edge["t"]);
+  colvec fp;
+  mat Pp;
+  if (ws >= te) {
+    fp = Rcpp::as<colvec>(edge["F"]);
+    Pp = Rcpp::as<mat>(edge["P"]);
+    filterAdvance(Xo, Ac, Cc, Qc, R, te, ws, fp, Pp);
+  } else {
+    fp = Rcpp::as<colvec>(edge["F0"]);
+    Pp = Rcpp::as<mat>(edge["P0"]);
+    filterAdvance(Xo, Ac, Cc, Qc, R, 0, ws, fp, Pp);
+  }
+
+  // Old, revised (old data with revisions to previously observed cells) and new data over the window
+  mat Wo(L, n), Wr(L, n), Wn(L, n);
+  Wo.fill(datum::nan);
+  Wn.fill(datum::nan);
+  if (T > ws) {
+    Wo.rows(0, T - ws - 1) = Xo.rows(ws, T - 1);
+    Wn.rows(0, T - ws - 1) = Xn.rows(ws, T - 1);
+  }
+  Wr = Wo;
+  std::vector<uword> rel_i, rel_t; // releases: newly observed cells
+  for (int j = 0; j < n; ++j) for (int t = 0; t < L; ++t) {
+    const bool fo = std::isfinite(Wo(t, j)), fn = std::isfinite(Wn(t, j));
+    if (fo && fn) Wr(t, j) = Wn(t, j);
+    else if (!fo && fn) {
+      rel_i.push_back(j);
+      rel_t.push_back(t);
+    }
+  }
+
+  const int ts = t_target - ws;
+  const rowvec Cj = C.row(target);
+  mat Fs;
+  cube Ps, J;
+  windowSmoother(Wo, Ac, Cc, Qc, R, fp, Pp, Fs, Ps, J);
+  const double y_old = as_scalar(Cj * Fs.col(ts).head(r));
+  windowSmoother(Wn, Ac, Cc, Qc, R, fp, Pp, Fs, Ps, J);
+  const double y_new = as_scalar(Cj * Fs.col(ts).head(r));
+  windowSmoother(Wr, Ac, Cc, Qc, R, fp, Pp, Fs, Ps, J);
+  const double y_rev = as_scalar(Cj * Fs.col(ts).head(r));
+
+  // Smoothed cross-covariances (top r x r blocks) between all release periods and the target period, given the revised data
+  const int m = rel_i.size();
+  std::vector<uword> U(rel_t);
+  U.push_back(ts);
+  std::sort(U.begin(), U.end());
+  U.erase(std::unique(U.begin(), U.end()), U.end());
+  const int nu = U.size();
+  std::vector<int> pos(L, -1);
+  for (int k = 0; k < nu; ++k) pos[U[k]] = k;
+  field<mat> Cov(nu, nu); // Cov(k, l) = Cov(F_{U[k]}, F_{U[l]}), r x r
+  for (int l = 0; l < nu; ++l) {
+    mat M = Ps.slice(U[l]);
+    Cov(l, l) = M.submat(0, 0, r - 1, r - 1);
+    for (int t = (int)U[l] - 1, k = l - 1; k >= 0; --t) {
+      M = J.slice(t) * M;
+      if (t == (int)U[k]) {
+        Cov(k, l) = M.submat(0, 0, r - 1, r - 1);
+        Cov(l, k) = Cov(k, l).t();
+        --k;
+      }
+    }
+  }
+
+  // News, their covariance E[I I'] and covariance with the target E[y I']
+  colvec actual(m), expected(m), news(m), weight(m), contribution(m);
+  mat EII(m, m);
+  rowvec EyI(m);
+  for (int a = 0; a < m; ++a) {
+    const uword ia = rel_i[a], ka = pos[rel_t[a]];
+    actual[a] = Wn(rel_t[a], ia);
+    expected[a] = as_scalar(C.row(ia) * Fs.col(rel_t[a]).head(r));
+    news[a] = actual[a] - expected[a];
+    EyI[a] = as_scalar(Cj * Cov(pos[ts], ka) * C.row(ia).t());
+    for (int b = 0; b <= a; ++b) {
+      const uword ib = rel_i[b], kb = pos[rel_t[b]];
+      EII(a, b) = as_scalar(C.row(ia) * Cov(ka, kb) * C.row(ib).t()) + (ka == kb ? R(ia, ib) : 0.0);
+      EII(b, a) = EII(a, b);
+    }
+  }
+  if (m) {
+    weight = solve(EII, EyI.t(), solve_opts::likely_sympd);
+    contribution = weight % news;
+  }
+
+  Rcpp::IntegerVector series(m), period(m);
+  for (int a = 0; a < m; ++a) {
+    series[a] = rel_i[a] + 1;
+    period[a] = ws + rel_t[a] + 1;
+  }
+  return Rcpp::List::create(Rcpp::Named("y_old") = y_old,
+                            Rcpp::Named("y_rev") = y_rev,
+                            Rcpp::Named("y_new") = y_new,
+                            Rcpp::Named("series") = series,
+                            Rcpp::Named("period") = period,
+                            Rcpp::Named("actual") = actual,
+                            Rcpp::Named("expected") = expected,
+                            Rcpp::Named("news") = news,
+                            Rcpp::Named("weight") = weight,
+                            Rcpp::Named("contribution") = contribution,
+                            Rcpp::Named("window") = ws + 1);
+}
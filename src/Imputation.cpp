@@ -0,0 +1,441 @@
+#include <RcppArmadillo.h>
+#include "helper.h"
+
+// [[Rcpp::depends(RcppArmadillo)]]
+using namespace arma;
+
+
+// Median of the finite values in a column, 0 if there are none
+double finiteMedian(const colvec& x) {
+  colvec xf = x.elem(find_finite(x));
+  return xf.n_elem ? median(xf) : 0;
+}
+
+//' Iterative EM-PCA imputation of missing values (Stock and Watson, 2002)
+//' @param X Standardized data matrix (T x n) with missing values
+//' @param r Number of principal components
+//' @param maxit Maximum number of iterations
+//' @param tol Convergence tolerance on the relative change in the residual sum of squares
+// [[Rcpp::export]]
+arma::mat impNA_EMPCA(arma::mat X, int r, int maxit = 100, double tol = 1e-6) {
+
+  const uvec miss = find_nonfinite(X), obs = find_finite(X);
+  if (miss.n_elem == 0) return X;
+  r = std::min(r, int(std::min(X.n_rows, X.n_cols)));
+
+  // Initial median imputation
+  for (unsigned int j = 0; j < X.n_cols; ++j) {
+    colvec xj = X.col(j);
+    uvec nai = find_nonfinite(xj);
+    if (nai.n_elem) {
+      xj.elem(nai).fill(finiteMedian(xj));
+      X.col(j) = xj;
+    }
+  }
+
+  // Initial loadings from a (randomized) truncated SVD
+  colvec d;
+  mat U, V, Q, Rq, L;
+  if (std::min(X.n_rows, X.n_cols) >= 500 && int(std::min(X.n_rows, X.n_cols)) > 10 * r) {
+    rsvdCore(X, r, 10, 2, 1, d, U, V);
+  } else {
+    svd_econ(U, d, V, X, "right");
+    V = V.cols(0, r-1);
+  }
+
+  double ssr, prev_ssr = datum::inf;
+  for (int it = 0; it < maxit; ++it) {
+    // Warm-started subspace iteration: one power step from the previous loadings
+    qr_econ(Q, Rq, X * V);
+    mat B = Q.t() * X;
+    svd_econ(U, d, V, B, "right");
+    V = V.cols(0, r-1);
+    L = Q * B;
+
+    ssr = accu(square(X.elem(obs) - L.elem(obs)));
+    X.elem(miss) = L.elem(miss);
+    if (std::abs(prev_ssr - ssr) <= tol * (ssr + datum::eps)) break;
+    prev_ssr = ssr;
+  }
+  return X;
+}
+
+
+// Column-wise imputation kernels, replicating the arithmetic of fmedian(), stats::filter()
+// and stats::spline(method = "fmm") so that the results are identical to the former R code.
+// Each thread works on whole columns with a fixed set of scratch buffers.
+
+// Median of the non-NaN values in x[0:T-1] (as fmedian(x, na.rm = TRUE)), using buf as scratch
+static double colMedian(const double* x, int T, double* buf) {
+  int m = 0;
+  for (int t = 0; t < T; ++t) if (!ISNAN(x[t])) buf[m++] = x[t];
+  if (m == 0) return NA_REAL;
+  int h = (m - 1) / 2;
+  std::nth_element(buf, buf + h, buf + m);
+  double med = buf[h];
+  if (m % 2 == 0) med = (med + *std::min_element(buf + h + 1, buf + m)) / 2.0;
+  return med;
+}
+
+// Replaces x[t] for all t in nai[0:nn-1] by the centered moving average of order 2k+1,
+// padding the series with its first and last values, as
+// filter(c(rep(x[1], k), x, rep(x[T], k)), rep(1, 2k+1)/(2k+1), sides = 1)[-(1:2k)].
+// xf holds the series used to compute the averages (x may be the same array).
+static void colMA(double* x, const double* xf, int T, int k, const int* nai, int nn) {
+  const int k2 = 2 * k + 1;
+  const double w = 1.0 / k2;
+  for (int i = 0; i < nn; ++i) {
+    const int t = nai[i];
+    double z = 0;
+    bool ok = true;
+    for (int j = 0; j < k2; ++j) {
+      int s = t + k - j;
+      double v = xf[s < 0 ? 0 : s >= T ? T - 1 : s];
+      if (ISNAN(v)) {
+        ok = false;
+        break;
+      }
+      z += w * v;
+    }
+    x[t] = ok ? z : NA_REAL;
+  }
+}
+
+// Forsythe, Malcolm and Moler cubic spline coefficients (R's fmm_spline in splines.c, 0-based)
+static void fmmSpline(int n, const double* x, const double* y, double* b, double* c, double* d) {
+  if (n < 3) {
+    double t = (y[1] - y[0]);
+    b[0] = t / (x[1]-x[0]);
+    b[1] = b[0];
+    c[0] = c[1] = d[0] = d[1] = 0.0;
+    return;
+  }
+  const int n1 = n-1, n2 = n-2;
+  int i;
+  // Set up tridiagonal system: b = diagonal, d = offdiagonal, c = right hand side
+  d[0] = x[1] - x[0];
+  c[1] = (y[1] - y[0])/d[0];
+  for (i = 1; i < n1; i++) {
+    d[i] = x[i+1] - x[i];
+    b[i] = 2.0 * (d[i-1] + d[i]);
+    c[i+1] = (y[i+1] - y[i])/d[i];
+    c[i] = c[i+1] - c[i];
+  }
+  // End conditions: third derivatives at x[0] and x[n-1] obtained from divided differences
+  b[0] = -d[0];
+  b[n1] = -d[n2];
+  c[0] = c[n1] = 0.0;
+  if (n > 3) {
+    c[0] = c[2]/(x[3]-x[1]) - c[1]/(x[2]-x[0]);
+    c[n1] = c[n2]/(x[n1] - x[n-3]) - c[n-3]/(x[n2]-x[n-4]);
+    c[0] = c[0]*d[0]*d[0]/(x[3]-x[0]);
+    c[n1] = -c[n1]*d[n2]*d[n2]/(x[n1]-x[n-4]);
+  }
+  // Gaussian elimination
+  for (i = 1; i < n; i++) {
+    double t = d[i-1]/b[i-1];
+    b[i] = b[i] - t*d[i-1];
+    c[i] = c[i] - t*c[i-1];
+  }
+  // Backward substitution
+  c[n1] = c[n1]/b[n1];
+  for (i = n2; i >= 0; i--) c[i] = (c[i]-d[i]*c[i+1])/b[i];
+  // Compute polynomial coefficients
+  b[n1] = (y[n1] - y[n2])/d[n2] + d[n2]*(c[n2]+ 2.0*c[n1]);
+  for (i = 0; i < n1; i++) {
+    b[i] = (y[i+1]-y[i])/d[i] - d[i]*(c[i+1]+2.0*c[i]);
+    d[i] = (c[i+1]-c[i])/d[i];
+    c[i] = 3.0*c[i];
+  }
+  c[n1] = 3.0*c[n1];
+  d[n1] = d[n2];
+}
+
+// Evaluates the spline at the ascending points u[0:nu-1] (R's spline_eval in splines.c)
+static void fmmSplineEval(int nu, const double* u, double* v, int n,
+                          const double* x, const double* y, const double* b, const double* c, const double* d) {
+  const int n_1 = n - 1;
+  int i = 0;
+  for (int l = 0; l < nu; l++) {
+    double ul = u[l];
+    if (ul < x[i] || (i < n_1 && x[i+1] < ul)) {
+      // reset i such that x[i] <= ul <= x[i+1]
+      i = 0;
+      int j = n;
+      do {
+        int k = (i+j)/2;
+        if (ul < x[k]) j = k; else i = k;
+      } while (j > i+1);
+    }
+    double dx = ul - x[i];
+    v[l] = y[i] + dx*(b[i] + dx*(c[i] + dx*d[i]));
+  }
+}
+
+// [[Rcpp::export]]
+Rcpp::NumericMatrix impNA_median(Rcpp::NumericMatrix X, Rcpp::RawVector W, int nthreads = 1) {
+  const int T = X.nrow(), n = X.ncol();
+  Rcpp::NumericMatrix res = Rcpp::clone(X);
+  double *px = res.begin();
+  const unsigned char *pw = RAW(W);
+  const size_t nb = maskBytes(T);
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<double> buf(T);
+    #pragma omp for schedule(static)
+    for (int j = 0; j < n; ++j) {
+      double *x = px + (size_t)j * T;
+      const unsigned char *w = pw + j * nb;
+      bool any = false;
+      for (size_t b = 0; b < nb && !any; ++b) any = w[b];
+      if (!any) continue;
+      double med = colMedian(x, T, buf.data());
+      for (int t = 0; t < T; ++t) if (maskGet(w, t)) x[t] = med;
+    }
+  }
+  return res;
+}
+
+// [[Rcpp::export]]
+Rcpp::NumericMatrix impNA_MA(Rcpp::NumericMatrix X, Rcpp::RawVector W, int k, int nthreads = 1) {
+  const int T = X.nrow(), n = X.ncol();
+  Rcpp::NumericMatrix res = Rcpp::clone(X);
+  double *px = res.begin();
+  const unsigned char *pw = RAW(W);
+  const size_t nb = maskBytes(T);
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<double> buf(T), xf(T);
+    std::vector<int> nai(T);
+    #pragma omp for schedule(static)
+    for (int j = 0; j < n; ++j) {
+      double *x = px + (size_t)j * T;
+      const unsigned char *w = pw + j * nb;
+      int nn = 0;
+      for (int t = 0; t < T; ++t) if (maskGet(w, t)) nai[nn++] = t;
+      if (nn == 0) continue;
+      double med = colMedian(x, T, buf.data());
+      for (int i = 0; i < nn; ++i) x[nai[i]] = med;
+      std::copy(x, x + T, xf.begin());
+      colMA(x, xf.data(), T, k, nai.data(), nn);
+    }
+  }
+  return res;
+}
+
+// [[Rcpp::export]]
+Rcpp::NumericMatrix impNA_spline(Rcpp::NumericMatrix X, Rcpp::RawVector W, int k, int nthreads = 1) {
+  const int T = X.nrow(), n = X.ncol();
+  Rcpp::NumericMatrix res = Rcpp::clone(X);
+  double *px = res.begin();
+  const unsigned char *pw = RAW(W);
+  const size_t nb = maskBytes(T);
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<double> buf(T), xf(T), kx(T), ky(T), b(T), c(T), d(T), u(T);
+    std::vector<int> nai(T);
+    #pragma omp for schedule(static)
+    for (int j = 0; j < n; ++j) {
+      double *x = px + (size_t)j * T;
+      const unsigned char *w = pw + j * nb;
+      // Knots: the non-missing observations
+      int ln = 0;
+      for (int t = 0; t < T; ++t) if (!maskGet(w, t)) {
+        kx[ln] = t + 1;
+        ky[ln++] = x[t];
+      }
+      if (ln == T) continue;
+      // Cubic spline to interpolate any internal missing values
+      if (ln > 1) {
+        const int t1 = kx[0], t2 = kx[ln-1];
+        if (ln != t2 - t1 + 1) {
+          for (int t = t1; t <= t2; ++t) u[t-t1] = t;
+          fmmSpline(ln, kx.data(), ky.data(), b.data(), c.data(), d.data());
+          fmmSplineEval(t2 - t1 + 1, u.data(), x + t1 - 1, ln, kx.data(), ky.data(), b.data(), c.data(), d.data());
+        }
+      }
+      // Median and moving average for the remaining values at the beginning and end
+      int nn = 0;
+      for (int t = 0; t < T; ++t) if (ISNAN(x[t])) nai[nn++] = t;
+      if (nn == 0) continue;
+      double med = colMedian(x, T, buf.data());
+      for (int i = 0; i < nn; ++i) x[nai[i]] = med;
+      std::copy(x, x + T, xf.begin());
+      colMA(x, xf.data(), T, k, nai.data(), nn);
+    }
+  }
+  return res;
+}
+
+//' One-pass standardization and missingness scan of a data matrix, returning a bit-packed mask
+//' @param X Data matrix (T x n)
+//' @param max_missing Proportion of missing series above which a row counts towards the leading/trailing runs
+//' @param scale Logical. Standardize the data and compute summary statistics?
+//' @param nthreads Number of threads to process columns in parallel
+// [[Rcpp::export]]
+Rcpp::List prepNA(Rcpp::NumericMatrix X, double max_missing = 1, bool scale = true, int nthreads = 1) {
+  const int T = X.nrow(), n = X.ncol();
+  const double *px = X.begin();
+  Rcpp::NumericMatrix Xs = scale ? Rcpp::NumericMatrix(T, n) : Rcpp::NumericMatrix(0, 0);
+  Rcpp::NumericMatrix stats = scale ? Rcpp::NumericMatrix(n, 5) : Rcpp::NumericMatrix(0, 0);
+  const size_t nb = maskBytes(T);
+  Rcpp::RawVector W(nb * n);
+  std::vector<int> nmiss(T, 0);
+  double *pxs = Xs.begin(), *ps = stats.begin();
+  unsigned char *pw = RAW(W);
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<int> cnt(T, 0);
+    #pragma omp for schedule(static)
+    for (int j = 0; j < n; ++j) {
+      const double *x = px + (size_t)j * T;
+      unsigned char *w = pw + j * nb;
+      if (scale) {
+        // Statistics of the non-NA values (as qsu()), and standardization (as fscale())
+        int N = 0;
+        long double sum = 0;
+        double mn = R_PosInf, mx = R_NegInf;
+        for (int t = 0; t < T; ++t) {
+          double v = x[t];
+          if (ISNAN(v)) continue;
+          ++N;
+          sum += v;
+          if (v < mn) mn = v;
+          if (v > mx) mx = v;
+        }
+        double mean = N ? (double)(sum / N) : NA_REAL, sd = NA_REAL;
+        if (N > 1) {
+          long double ss = 0;
+          for (int t = 0; t < T; ++t) if (!ISNAN(x[t])) ss += (x[t] - mean) * (x[t] - mean);
+          sd = std::sqrt((double)(ss / (N - 1)));
+        }
+        ps[j] = N;
+        ps[j + n] = mean;
+        ps[j + 2 * n] = sd;
+        ps[j + 3 * n] = N ? mn : NA_REAL;
+        ps[j + 4 * n] = N ? mx : NA_REAL;
+        double *xs = pxs + (size_t)j * T;
+        for (int t = 0; t < T; ++t) {
+          double v = (x[t] - mean) / sd;
+          xs[t] = v;
+          if (!std::isfinite(v)) {
+            maskSet(w, t);
+            ++cnt[t];
+          }
+        }
+      } else {
+        for (int t = 0; t < T; ++t) if (!std::isfinite(x[t])) {
+          maskSet(w, t);
+          ++cnt[t];
+        }
+      }
+    }
+    #pragma omp critical
+    for (int t = 0; t < T; ++t) nmiss[t] += cnt[t];
+  }
+
+  // Leading and trailing runs of rows with more than max_missing * n missing values
+  const double thresh = max_missing * n;
+  int lead = 0, trail = 0;
+  double tot = 0;
+  while (lead < T && nmiss[lead] > thresh) ++lead;
+  while (trail < T && nmiss[T - 1 - trail] > thresh) ++trail;
+  for (int t = 0; t < T; ++t) tot += nmiss[t];
+
+  Rcpp::RObject dn = X.attr("dimnames");
+  W.attr("dims") = Rcpp::IntegerVector::create(T, n);
+  W.attr("nmiss") = tot;
+  Rcpp::List res = Rcpp::List::create(Rcpp::Named("X") = R_NilValue,
+                                      Rcpp::Named("stats") = R_NilValue,
+                                      Rcpp::Named("W") = W,
+                                      Rcpp::Named("nmiss") = Rcpp::wrap(nmiss),
+                                      Rcpp::Named("lead") = lead,
+                                      Rcpp::Named("trail") = trail,
+                                      Rcpp::Named("anyNA") = tot > 0);
+  if (scale) {
+    Xs.attr("dimnames") = dn;
+    Rcpp::RObject cn = dn.isNULL() ? Rcpp::RObject(R_NilValue) : Rcpp::RObject(Rcpp::List(dn)[1]);
+    stats.attr("dimnames") = Rcpp::List::create(cn, Rcpp::CharacterVector::create("N", "Mean", "SD", "Min", "Max"));
+    stats.attr("class") = Rcpp::CharacterVector::create("qsu", "matrix", "table");
+    res["X"] = Xs;
+    res["stats"] = stats;
+  }
+  return res;
+}
+
+//' Expand a bit-packed missingness mask to a logical matrix
+//' @param M Mask returned by prepNA()
+// [[Rcpp::export]]
+Rcpp::LogicalMatrix unpackNA(Rcpp::RawVector M) {
+  Rcpp::IntegerVector d = M.attr("dims");
+  const int T = d[0], n = d[1];
+  const size_t nb = maskBytes(T);
+  const unsigned char *pm = RAW(M);
+  Rcpp::LogicalMatrix W(T, n);
+  int *pw = W.begin();
+  for (int j = 0; j < n; ++j) {
+    const unsigned char *m = pm + j * nb;
+    for (int t = 0; t < T; ++t) pw[(size_t)j * T + t] = maskGet(m, t);
+  }
+  return W;
+}
+
+//' Remove rows from a bit-packed missingness mask
+//' @param M Mask returned by prepNA()
+//' @param rm Rows to remove (1-based, ascending)
+// [[Rcpp::export]]
+Rcpp::RawVector maskRows(Rcpp::RawVector M, Rcpp::IntegerVector rm) {
+  Rcpp::IntegerVector d = M.attr("dims");
+  const int T = d[0], n = d[1];
+  std::vector<int> keep;
+  keep.reserve(T);
+  for (int t = 0, i = 0; t < T; ++t) {
+    if (i < rm.size() && rm[i] == t + 1) ++i;
+    else keep.push_back(t);
+  }
+  const int Tk = keep.size();
+  const size_t nb = maskBytes(T), nbk = maskBytes(Tk);
+  const unsigned char *pm = RAW(M);
+  Rcpp::RawVector res(nbk * n);
+  unsigned char *pr = RAW(res);
+  double tot = 0;
+  for (int j = 0; j < n; ++j) {
+    const unsigned char *m = pm + j * nb;
+    unsigned char *r = pr + j * nbk;
+    for (int t = 0; t < Tk; ++t) if (maskGet(m, keep[t])) {
+      maskSet(r, t);
+      ++tot;
+    }
+  }
+  res.attr("dims") = Rcpp::IntegerVector::create(Tk, n);
+  res.attr("nmiss") = tot;
+  return res;
+}
+
+//' Replace the cells flagged in a bit-packed missingness mask
+//' @param X Matrix (T x n)
+//' @param M Mask returned by prepNA()
+//' @param value Replacement value, or vector of replacement values for the flagged cells in column-major order
+// [[Rcpp::export]]
+Rcpp::NumericMatrix setNA(Rcpp::NumericMatrix X, Rcpp::RawVector M, Rcpp::NumericVector value) {
+  const int T = X.nrow(), n = X.ncol();
+  const size_t nb = maskBytes(T);
+  const unsigned char *pm = RAW(M);
+  const bool scalar = value.size() == 1;
+  Rcpp::NumericMatrix res = Rcpp::clone(X);
+  double *px = res.begin();
+  R_xlen_t k = 0;
+  for (int j = 0; j < n; ++j) {
+    const unsigned char *m = pm + j * nb;
+    double *x = px + (size_t)j * T;
+    for (size_t b = 0; b < nb; ++b) {
+      if (!m[b]) continue; // skip blocks of 8 observed cells
+      const int t1 = std::min(8 * (int)b + 8, T);
+      for (int t = 8 * (int)b; t < t1; ++t) if (maskGet(m, t)) {
+        if (!scalar && k >= value.size()) Rcpp::stop("Fewer replacement values than flagged cells");
+        x[t] = value[scalar ? 0 : k++];
+      }
+    }
+  }
+  return res;
+}
@@ -0,0 +1,262 @@
+#include <RcppArmadillo.h>
+#include <vector>
+#include <algorithm>
+#include "KalmanFiltering.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// [[Rcpp::depends(RcppArmadillo)]]
+using namespace arma;
+
+// Number of models filtered in lock-step
+#define KB_W 8
+
+struct BatchModel {
+  mat X, C, Q, R, A, P0;
+  colvec F0;
+  // Outputs as in KalmanFilter()
+  mat FT, PT;
+  cube PfT, PpT;
+  double loglik;
+};
+
+// Kalman filter for up to KB_W models with the same state dimension N and diagonal R, run in
+// lock-step. All state and system quantities are held in structure-of-arrays layout: element e of
+// lane l is stored at [e * KB_W + l], so that the innermost loops run over the lanes and are
+// vectorised. The observations are absorbed one series at a time as in KalmanUpdateCell(), which
+// needs no matrix inversion and thus has the same control flow in all lanes. Missing values, series
+// beyond the number of series of a lane and periods beyond its sample are masked per lane.
+static void KalmanFilterLanes(std::vector<BatchModel*>& m, int N) {
+
+  const int L = m.size(), NN = N * N;
+  int nmax = 0, Tmax = 0;
+  for (int l = 0; l < L; ++l) {
+    nmax = std::max(nmax, (int)m[l]->X.n_cols);
+    Tmax = std::max(Tmax, (int)m[l]->X.n_rows);
+  }
+  const double log2pi = log(2.0 * datum::pi);
+
+  // System matrices, with unused lanes running a model without observations
+  std::vector<double> A(NN * KB_W, 0), Q(NN * KB_W, 0), C(nmax * N * KB_W, 0), r(nmax * KB_W, 1),
+                      f(N * KB_W, 0), P(NN * KB_W, 0), AP(NN * KB_W), Pc(N * KB_W), x(nmax * KB_W),
+                      ll0(KB_W, 0), ll(KB_W);
+  for (int l = 0; l < L; ++l) {
+    const BatchModel& b = *m[l];
+    const int n = b.X.n_cols;
+    for (int e = 0; e < NN; ++e) {
+      A[e * KB_W + l] = b.A[e];
+      Q[e * KB_W + l] = b.Q[e];
+      P[e * KB_W + l] = b.P0[e];
+    }
+    for (int k = 0; k < N; ++k) f[k * KB_W + l] = b.F0[k];
+    for (int i = 0; i < n; ++i) {
+      r[i * KB_W + l] = b.R(i, i);
+      for (int k = 0; k < N; ++k) C[(i * N + k) * KB_W + l] = b.C(i, k);
+    }
+    ll0[l] = -0.5 * double(n) * log2pi;
+  }
+
+  for (int t = 0; t < Tmax; ++t) {
+
+    // Gather the observations of this period
+    for (int l = 0; l < KB_W; ++l) {
+      const BatchModel* b = l < L ? m[l] : NULL;
+      for (int i = 0; i < nmax; ++i)
+        x[i * KB_W + l] = b != NULL && t < (int)b->X.n_rows && i < (int)b->X.n_cols ? b->X(t, i) : datum::nan;
+    }
+
+    // Store the predicted state
+    for (int l = 0; l < L; ++l) {
+      BatchModel& b = *m[l];
+      if (t >= (int)b.X.n_rows) continue;
+      double* Pp = b.PpT.slice_memptr(t);
+      for (int e = 0; e < NN; ++e) Pp[e] = P[e * KB_W + l];
+      for (int k = 0; k < N; ++k) b.PT(t, k) = f[k * KB_W + l];
+    }
+
+    // Measurement update, one series at a time
+    std::copy(ll0.begin(), ll0.end(), ll.begin());
+    for (int i = 0; i < nmax; ++i) {
+      const double* ci = &C[i * N * KB_W];
+      const double* xi = &x[i * KB_W];
+      const double* ri = &r[i * KB_W];
+      double s[KB_W], v[KB_W], w[KB_W];
+      // P c and the innovation variance s = c'P c + r
+      for (int k = 0; k < N; ++k) {
+        double* pck = &Pc[k * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) pck[l] = 0;
+        for (int j = 0; j < N; ++j) {
+          const double* pkj = &P[(k + j * N) * KB_W];
+          const double* cj = ci + j * KB_W;
+          #pragma omp simd
+          for (int l = 0; l < KB_W; ++l) pck[l] += pkj[l] * cj[l];
+        }
+      }
+      #pragma omp simd
+      for (int l = 0; l < KB_W; ++l) {
+        s[l] = ri[l];
+        v[l] = xi[l];
+      }
+      for (int k = 0; k < N; ++k) {
+        const double* ck = ci + k * KB_W;
+        const double* pck = &Pc[k * KB_W];
+        const double* fk = &f[k * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) {
+          s[l] += ck[l] * pck[l];
+          v[l] -= ck[l] * fk[l];
+        }
+      }
+      // Lanes where the series is missing (or the innovation variance is not positive) get zero
+      // weight. v - v is 0 unless v is NaN or infinite.
+      #pragma omp simd
+      for (int l = 0; l < KB_W; ++l) {
+        const bool obs = v[l] - v[l] == 0 && s[l] > 0;
+        w[l] = obs ? 1.0 / s[l] : 0;
+        v[l] = obs ? v[l] : 0;
+        s[l] = obs ? s[l] : 1;
+      }
+      for (int l = 0; l < KB_W; ++l) ll[l] -= 0.5 * (log(s[l]) + v[l] * v[l] * w[l]);
+      // f += P c v / s, P -= P c c'P / s
+      for (int k = 0; k < N; ++k) {
+        const double* pck = &Pc[k * KB_W];
+        double* fk = &f[k * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) fk[l] += pck[l] * v[l] * w[l];
+        for (int j = 0; j < N; ++j) {
+          const double* pcj = &Pc[j * KB_W];
+          double* pkj = &P[(k + j * N) * KB_W];
+          #pragma omp simd
+          for (int l = 0; l < KB_W; ++l) pkj[l] -= pck[l] * pcj[l] * w[l];
+        }
+      }
+    }
+
+    // Scatter the filtered state and the log-likelihood
+    for (int l = 0; l < L; ++l) {
+      BatchModel& b = *m[l];
+      if (t >= (int)b.X.n_rows) continue;
+      double* Pf = b.PfT.slice_memptr(t);
+      for (int e = 0; e < NN; ++e) Pf[e] = P[e * KB_W + l];
+      for (int k = 0; k < N; ++k) b.FT(t, k) = f[k * KB_W + l];
+      b.loglik += ll[l];
+    }
+
+    // Prediction: f = A f, P = A P A' + Q
+    for (int i = 0; i < N; ++i) {
+      double* api = &AP[i * KB_W];
+      #pragma omp simd
+      for (int l = 0; l < KB_W; ++l) api[l] = 0;
+      for (int k = 0; k < N; ++k) {
+        const double* aik = &A[(i + k * N) * KB_W];
+        const double* fk = &f[k * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) api[l] += aik[l] * fk[l];
+      }
+    }
+    std::copy(AP.begin(), AP.begin() + N * KB_W, f.begin());
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) {
+        double* apij = &AP[(i + j * N) * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) apij[l] = 0;
+        for (int k = 0; k < N; ++k) {
+          const double* aik = &A[(i + k * N) * KB_W];
+          const double* pkj = &P[(k + j * N) * KB_W];
+          #pragma omp simd
+          for (int l = 0; l < KB_W; ++l) apij[l] += aik[l] * pkj[l];
+        }
+      }
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) {
+        double* pij = &P[(i + j * N) * KB_W];
+        const double* qij = &Q[(i + j * N) * KB_W];
+        #pragma omp simd
+        for (int l = 0; l < KB_W; ++l) pij[l] = qij[l];
+        for (int k = 0; k < N; ++k) {
+          const double* apik = &AP[(i + k * N) * KB_W];
+          const double* ajk = &A[(j + k * N) * KB_W];
+          #pragma omp simd
+          for (int l = 0; l < KB_W; ++l) pij[l] += apik[l] * ajk[l];
+        }
+      }
+  }
+}
+
+
+//' Kalman filter for many models at once
+//' @param models List of models, each a list with elements X, C, Q, R, A, F0 and P0
+//' @param nthreads Number of threads
+// [[Rcpp::export]]
+Rcpp::List KalmanFilterBatch(Rcpp::List models, int nthreads = 1) {
+
+  const int nm = models.size();
+  std::vector<BatchModel> m(nm);
+  std::vector<int> lanes;
+  for (int i = 0; i < nm; ++i) {
+    Rcpp::List mi = models[i];
+    BatchModel& b = m[i];
+    b.X = Rcpp::as<mat>(mi["X"]);
+    b.C = Rcpp::as<mat>(mi["C"]);
+    b.Q = Rcpp::as<mat>(mi["Q"]);
+    b.R = Rcpp::as<mat>(mi["R"]);
+    b.A = Rcpp::as<mat>(mi["A"]);
+    b.F0 = Rcpp::as<colvec>(mi["F0"]);
+    b.P0 = Rcpp::as<mat>(mi["P0"]);
+    const uword n = b.X.n_cols, rp = b.A.n_rows;
+    if (b.C.n_rows != n || b.C.n_cols != rp || b.A.n_cols != rp || b.Q.n_rows != rp || b.Q.n_cols != rp ||
+        b.R.n_rows != n || b.R.n_cols != n || b.F0.n_elem != rp || b.P0.n_rows != rp || b.P0.n_cols != rp)
+      Rcpp::stop("Non-conformable system matrices in model %d", i + 1);
+    // Models with non-diagonal R are run with KalmanFilter() below
+    if (b.R.is_diagmat() && b.A.is_finite()) {
+      b.FT.zeros(b.X.n_rows, rp);
+      b.PT.zeros(b.X.n_rows + 1, rp);
+      b.PfT.zeros(rp, rp, b.X.n_rows);
+      b.PpT.zeros(rp, rp, b.X.n_rows + 1);
+      b.loglik = 0;
+      lanes.push_back(i);
+    }
+  }
+
+  // Blocks of up to KB_W models with the same state dimension
+  std::stable_sort(lanes.begin(), lanes.end(), [&](int i, int j) { return m[i].A.n_rows < m[j].A.n_rows; });
+  std::vector<std::vector<BatchModel*> > blocks;
+  for (size_t k = 0; k < lanes.size(); ++k) {
+    BatchModel* b = &m[lanes[k]];
+    if (blocks.empty() || blocks.back().size() == KB_W || blocks.back()[0]->A.n_rows != b->A.n_rows)
+      blocks.push_back(std::vector<BatchModel*>());
+    blocks.back().push_back(b);
+  }
+
+  const int nb = blocks.size();
+  std::vector<int> failed(nb, 0);
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+  for (int k = 0; k < nb; ++k) {
+    try {
+      KalmanFilterLanes(blocks[k], blocks[k][0]->A.n_rows);
+    } catch(...) {
+      failed[k] = 1;
+    }
+  }
+  for (int k = 0; k < nb; ++k) if (failed[k]) Rcpp::stop("Kalman filter failed for a block of models");
+
+  std::vector<bool> batched(nm, false);
+  for (size_t k = 0; k < lanes.size(); ++k) batched[lanes[k]] = true;
+  Rcpp::List out(nm);
+  for (int i = 0; i < nm; ++i) {
+    BatchModel& b = m[i];
+    if (!batched[i]) {
+      out[i] = KalmanFilter(b.X, b.C, b.Q, b.R, b.A, b.F0, b.P0);
+      continue;
+    }
+    out[i] = Rcpp::List::create(Rcpp::Named("F") = b.FT,
+                                Rcpp::Named("Pf") = b.PfT,
+                                Rcpp::Named("P") = b.PT,
+                                Rcpp::Named("Pp") = b.PpT,
+                                Rcpp::Named("loglik") = b.loglik);
+  }
+  out.attr("names") = models.attr("names");
+  return out;
+}
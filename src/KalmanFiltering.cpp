@@ -1,10 +1,245 @@
 #include <RcppArmadillo.h>
 #include "helper.h"
+#include "MappedCube.h"
+#include "KalmanFixed.h"
+#include "SmallKernels.h"
 
 // [[Rcpp::depends(RcppArmadillo)]]
 using namespace arma;
 
 
+// Kalman filter with the fixed-size kernels (R diagonal), storing the predicted (PT, PpT) and
+// filtered (FT, PfT) states and covariances. Returns the log-likelihood.
+template <int N, class Store>
+static double KalmanFilterFixed(const mat& X, const mat& C, const colvec& rinv, const mat& A, const mat& Q,
+                                const colvec& F0, const mat& P0, mat& PT, Store& PpT, mat& FT, Store& PfT) {
+
+  const int T = X.n_rows;
+  const int n = X.n_cols;
+  const mat Xt = X.t(), Ct = C.t();
+  const double ll0 = double(n) * log(2.0 * datum::pi);
+
+  double Gfull[N * N], fp[N], Pp[N * N], ff[N], Pf[N * N];
+  KalmanFixed<N>::info(Ct.memptr(), rinv.memptr(), n, Gfull);
+  const double logrfull = -accu(log(rinv));
+  std::copy(F0.begin(), F0.end(), fp);
+  std::copy(P0.begin(), P0.end(), Pp);
+
+  double loglik = 0;
+  for (int t=0; t < T; ++t) {
+    const double q = KalmanFixed<N>::update(Ct.memptr(), rinv.memptr(), Xt.colptr(t), n,
+                                            Gfull, logrfull, fp, Pp, ff, Pf);
+    // Skip the likelihood if S is not positive definite
+    if (std::isfinite(q)) loglik -= 0.5 * (ll0 + q);
+
+    for (int k=0; k < N; ++k) {
+      PT(t, k) = fp[k];
+      FT(t, k) = ff[k];
+    }
+    setSlice(PpT, t, mat(Pp, N, N, false, true));
+    setSlice(PfT, t, mat(Pf, N, N, false, true));
+
+    KalmanFixed<N>::predict(A.memptr(), Q.memptr(), ff, Pf, fp, Pp);
+  }
+  return loglik;
+}
+
+// Same with the vectorised kernels k, which work on zero-padded SK_LD x SK_LD matrices
+template <class Store>
+static double KalmanFilterSIMD(const SmallKernels& k, const mat& X, const mat& C, const colvec& rinv,
+                               const mat& A, const mat& Q, const colvec& F0, const mat& P0,
+                               mat& PT, Store& PpT, mat& FT, Store& PfT) {
+
+  const int T = X.n_rows;
+  const int n = X.n_cols;
+  const int N = A.n_rows;
+  const mat Xt = X.t();
+  const double ll0 = double(n) * log(2.0 * datum::pi);
+
+  mat Ct(SK_LD, n, fill::zeros), Ap(SK_LD, SK_LD, fill::zeros), Qp(SK_LD, SK_LD, fill::zeros);
+  mat Gfull(SK_LD, SK_LD, fill::zeros), Pp(SK_LD, SK_LD, fill::zeros), Pf(SK_LD, SK_LD, fill::zeros);
+  colvec fp(SK_LD, fill::zeros), ff(SK_LD, fill::zeros);
+  Ct.rows(0, N-1) = C.t();
+  Ap.submat(0, 0, N-1, N-1) = A;
+  Qp.submat(0, 0, N-1, N-1) = Q;
+  Pp.submat(0, 0, N-1, N-1) = P0;
+  fp.head(N) = F0;
+  k.info(N, Ct.memptr(), rinv.memptr(), n, Gfull.memptr());
+  const double logrfull = -accu(log(rinv));
+
+  double loglik = 0;
+  for (int t=0; t < T; ++t) {
+    const double q = k.update(N, Ct.memptr(), rinv.memptr(), Xt.colptr(t), n, Gfull.memptr(), logrfull,
+                              fp.memptr(), Pp.memptr(), ff.memptr(), Pf.memptr());
+    // Skip the likelihood if S is not positive definite
+    if (std::isfinite(q)) loglik -= 0.5 * (ll0 + q);
+
+    PT.row(t) = fp.head(N).t();
+    FT.row(t) = ff.head(N).t();
+    setSlice(PpT, t, Pp.submat(0, 0, N-1, N-1));
+    setSlice(PfT, t, Pf.submat(0, 0, N-1, N-1));
+
+    k.predict(N, Ap.memptr(), Qp.memptr(), ff.memptr(), Pf.memptr(), fp.memptr(), Pp.memptr());
+  }
+  return loglik;
+}
+
+// KalmanFilterFixed() for a state dimension rp <= KALMAN_FIXED_MAX given at runtime
+template <class Store>
+static double KalmanFilterFixedN(const mat& X, const mat& C, const colvec& rinv, const mat& A, const mat& Q,
+                                 const colvec& F0, const mat& P0, mat& PT, Store& PpT, mat& FT, Store& PfT) {
+  switch (A.n_rows) {
+  case 1: return KalmanFilterFixed<1>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 2: return KalmanFilterFixed<2>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 3: return KalmanFilterFixed<3>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 4: return KalmanFilterFixed<4>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 5: return KalmanFilterFixed<5>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 6: return KalmanFilterFixed<6>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  case 7: return KalmanFilterFixed<7>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  default: return KalmanFilterFixed<8>(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  }
+}
+
+// The vectorised kernels are faster than the unrolled ones from this state dimension onwards
+#define SK_MIN_RP 5
+
+// Runs the filter with the fixed-size kernels for rp <= KALMAN_FIXED_MAX if R is diagonal with positive
+// elements: the vectorised ones for rp >= SK_MIN_RP if the CPU supports them, and the compile-time ones
+// otherwise. Returns false (without running anything) so that the caller runs the general filter.
+template <class Store>
+static bool KalmanFilterFixedDispatch(const mat& X, const mat& C, const mat& R, const mat& A, const mat& Q,
+                                      const colvec& F0, const mat& P0, mat& PT, Store& PpT, mat& FT, Store& PfT,
+                                      double& loglik) {
+
+  const uword rp = A.n_rows;
+  if (rp > KALMAN_FIXED_MAX || C.n_cols != rp || find_finite(A.row(0)).eval().n_elem != rp ||
+      !R.is_diagmat() || !all(R.diag() > 0)) return false;
+  const colvec rinv = 1.0 / R.diag();
+
+  const SmallKernels* k = smallKernels();
+  if (k != NULL && rp >= SK_MIN_RP)
+    loglik = KalmanFilterSIMD(*k, X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  else loglik = KalmanFilterFixedN(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+  return true;
+}
+
+// Measurement update of the Kalman filter with the non-missing observations in row t of X:
+// (ff, Pf) from the prediction (fp, Pp). Returns the log-likelihood contribution of the row,
+// with n log(2 pi) for all n series, and 0 if S is not positive definite. Shared by all
+// filters and smoothers that do not use the fixed-size kernels, and the forecasting routines.
+double KalmanFilterStep(const mat& X, int t, const mat& C, const mat& R,
+                               const colvec& fp, const mat& Pp, colvec& ff, mat& Pf) {
+
+  const uvec miss = find_finite(X.row(t));
+  const mat Ct = C.rows(miss);
+  uvec a(1);
+  a[0] = t;
+
+  const mat S = (Ct * Pp * Ct.t() + R.submat(miss, miss)).i();
+  // Prediction error
+  const colvec xe = X.submat(a, miss).t() - Ct * fp;
+  // Kalman gain
+  const mat K = Pp * Ct.t() * S;
+  // Updated state estimate and covariance
+  ff = fp + K * xe;
+  Pf = Pp - K * Ct * Pp;
+
+  // Skip this part if S is not positive definite.
+  const double dS = det(S);
+  if (dS > 0) return -0.5 * (double(X.n_cols) * log(2.0 * datum::pi) - log(dS) +
+    conv_to<double>::from(xe.t() * S * xe));
+  return 0;
+}
+
+// General Kalman filter recursion (any R), storing the predicted (PT, PpT) and filtered (FT, PfT)
+// states and covariances. Returns the log-likelihood.
+template <class Store>
+static double KalmanFilterGeneral(const mat& X, const mat& C, const mat& R, const mat& A, const mat& Q,
+                                  const colvec& F0, const mat& P0, mat& PT, Store& PpT, mat& FT, Store& PfT) {
+
+  const int T = X.n_rows;
+
+  double loglik = 0;
+  mat Pf, Pp = P0;
+  colvec ff, fp = F0;
+
+  for (int t=0; t < T; ++t) {
+
+    loglik += KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+
+    // Store predicted and filtered data needed for smoothing
+    PT.row(t) = fp.t();
+    setSlice(PpT, t, Pp);
+    FT.row(t) = ff.t();
+    setSlice(PfT, t, Pf);
+
+    // Run a prediction
+    fp = A * ff;
+    Pp = A * Pf * A.t() + Q;
+
+  }
+  return loglik;
+}
+
+// Kalman filter with a given kernel, used in the tests to compare the kernels to the general recursion:
+// "general", "fixed" (the compile-time kernels) or one of the instruction sets listed by KalmanKernelInfo().
+// Returns the filtered states F and covariances Pf and the log-likelihood, or NULL if the CPU does not
+// support the kernel.
+// [[Rcpp::export]]
+SEXP KalmanFilterKernel(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                        arma::mat A, arma::colvec F0, arma::mat P0, std::string kernel) {
+
+  const int T = X.n_rows;
+  const int rp = A.n_rows;
+  mat PT(T+1, rp, fill::zeros), FT(T, rp, fill::zeros);
+  cube PpT(rp, rp, T+1, fill::zeros), PfT(rp, rp, T, fill::zeros);
+  double loglik;
+  if (kernel == "general") {
+    loglik = KalmanFilterGeneral(X, C, R, A, Q, F0, P0, PT, PpT, FT, PfT);
+  } else {
+    if (rp > KALMAN_FIXED_MAX || C.n_cols != (uword)rp || find_finite(A.row(0)).eval().n_elem != (uword)rp ||
+        !R.is_diagmat() || !all(R.diag() > 0))
+      Rcpp::stop("The fixed-size kernels require rp <= %d and a diagonal R with positive elements", KALMAN_FIXED_MAX);
+    const colvec rinv = 1.0 / R.diag();
+    if (kernel == "fixed") {
+      loglik = KalmanFilterFixedN(X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+    } else {
+      const SmallKernels* const* all;
+      const int nk = smallKernelsAll(&all);
+      int v = 0;
+      while (v < nk && kernel != all[v]->isa) ++v;
+      if (v == nk) Rcpp::stop("Unknown kernel: %s", kernel);
+      if (!all[v]->supported()) return R_NilValue;
+      loglik = KalmanFilterSIMD(*all[v], X, C, rinv, A, Q, F0, P0, PT, PpT, FT, PfT);
+    }
+  }
+  return Rcpp::List::create(Rcpp::Named("F") = FT,
+                            Rcpp::Named("Pf") = PfT,
+                            Rcpp::Named("loglik") = loglik);
+}
+
+// Instruction sets of the vectorised kernels compiled into the package, whether the CPU supports them,
+// and whether the filter uses them (for rp >= min_rp)
+// [[Rcpp::export]]
+Rcpp::DataFrame KalmanKernelInfo() {
+  const SmallKernels* const* all;
+  const int nk = smallKernelsAll(&all);
+  const SmallKernels* sel = smallKernels();
+  Rcpp::CharacterVector isa(nk);
+  Rcpp::LogicalVector supported(nk), used(nk);
+  for (int v = 0; v < nk; ++v) {
+    isa[v] = all[v]->isa;
+    supported[v] = all[v]->supported();
+    used[v] = all[v] == sel;
+  }
+  return Rcpp::DataFrame::create(Rcpp::Named("isa") = isa,
+                                 Rcpp::Named("supported") = supported,
+                                 Rcpp::Named("used") = used,
+                                 Rcpp::Named("min_rp") = SK_MIN_RP,
+                                 Rcpp::Named("stringsAsFactors") = false);
+}
+
+
 //' Implementation of a Kalman filter
 //' @param X Data matrix (T x n)
 //' @param C Observation matrix
@@ -18,12 +253,9 @@ Rcpp::List KalmanFilter(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
                         arma::mat A, arma::colvec F0, arma::mat P0) {
 
   const int T = X.n_rows;
-  const int n = X.n_cols;
   const int rp = A.n_rows;
 
   double loglik = 0;
-  mat K, Pf, Pp;
-  colvec ff, fp, xe;
   // Predicted state mean and covariance
   mat PT(T+1, rp, fill::zeros);
   cube PpT(rp, rp, T+1, fill::zeros);
@@ -32,59 +264,54 @@ Rcpp::List KalmanFilter(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
   mat FT(T, rp, fill::zeros);
   cube PfT(rp, rp, T, fill::zeros);
 
-  mat tC = C;
-  mat tR = R;
-  mat S;
-  uvec miss;
-  uvec nmiss = find_finite(A.row(0));
-  uvec a(1);
+  // Small models with diagonal R use the fixed-size kernels
+  if (!KalmanFilterFixedDispatch(X, C, R, A, Q, F0, P0, PT, PpT, FT, PfT, loglik))
+    loglik = KalmanFilterGeneral(X, C, R, A, Q, F0, P0, PT, PpT, FT, PfT);
 
-  fp = F0;
-  Pp = P0;
+  return Rcpp::List::create(Rcpp::Named("F") = FT,
+                            Rcpp::Named("Pf") = PfT,
+                            Rcpp::Named("P") = PT,
+                            Rcpp::Named("Pp") = PpT,
+                            Rcpp::Named("loglik") = loglik);
+}
 
-  for (int t=0; t < T; ++t) {
 
-    // If missing observations are present at some timepoints, exclude the
-    // appropriate matrix slices from the filtering procedure.
-    miss = find_finite(X.row(t));
-    C = tC.submat(miss, nmiss);
-    R = tR.submat(miss, miss);
-    a[0] = t;
+// Check a (1-based) time range passed from R, and convert it to 0-based indices
+static bool checkRange(const Rcpp::IntegerVector& range, int T, int& t0, int& t1) {
+  if (range.size() == 0) return false;
+  if (range.size() != 2 || range[0] == NA_INTEGER || range[1] == NA_INTEGER ||
+      range[0] < 1 || range[0] > range[1] || range[1] > T)
+    Rcpp::stop("range must be a vector c(t0, t1) with 1 <= t0 <= t1 <= T");
+  t0 = range[0] - 1;
+  t1 = range[1] - 1;
+  return true;
+}
 
-    S = (C * Pp * C.t() + R).i();
-
-    // Prediction error
-    xe = X.submat(a, miss).t() - C * fp;
-    // Kalman gain
-    K = Pp * C.t() * S;
-    // Updated state estimate
-    ff = fp + K * xe;
-    // Updated state covariance estimate
-    Pf = Pp - K * C * Pp;
-
-    // Compute likelihood. Skip this part if S is not positive definite.
-    if (det(S) > 0) {
-      loglik += -0.5 * (double(n) * log(2.0 * datum::pi) - log(det(S)) +
-        conv_to<double>::from(xe.t() * S * xe));
-    }
+// Backward recursion from the end of the sample down to t0, computing the smoother gains J on the
+// fly and storing the smoothed states and covariances for [t0, t1] only. The filtered (FT, PfT)
+// and predicted (PT, PpT) states are stored from time off onwards.
+static void KalmanSmoothRange(const mat& A, const mat& FT, const mat& PT, const cube& PfT, const cube& PpT,
+                              int off, int t0, int t1, mat& FsT, cube& PsT) {
 
-    // Store predicted and filtered data needed for smoothing
-    PT.row(t) = fp.t();
-    PpT.slice(t) = Pp;
-    FT.row(t) = ff.t();
-    PfT.slice(t) = Pf;
+  const int T = off + FT.n_rows;
+  const int rp = A.n_rows;
 
-    // Run a prediction
-    fp = A * FT.row(t).t();
-    Pp = A * PfT.slice(t) * A.t() + Q;
+  FsT.set_size(t1-t0+1, rp);
+  PsT.set_size(rp, rp, t1-t0+1);
+  rowvec Fs = FT.row(T-1-off);
+  mat Ps = PfT.slice(T-1-off), J;
 
+  for (int t = T-1; ; --t) {
+    if (t <= t1) {
+      FsT.row(t-t0) = Fs;
+      PsT.slice(t-t0) = Ps;
+    }
+    if (t == t0) break;
+    const int k = t-1-off;
+    J = PfT.slice(k) * A.t() * PpT.slice(k+1).i();
+    Fs = FT.row(k) + (J * (Fs - PT.row(k+1)).t()).t();
+    Ps = PfT.slice(k) + J * (Ps - PpT.slice(k+1)) * J.t();
   }
-
-  return Rcpp::List::create(Rcpp::Named("F") = FT,
-                            Rcpp::Named("Pf") = PfT,
-                            Rcpp::Named("P") = PT,
-                            Rcpp::Named("Pp") = PpT,
-                            Rcpp::Named("loglik") = loglik);
 }
 
 
@@ -96,23 +323,31 @@ Rcpp::List KalmanFilter(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
 //' @param PTm State predicted estimates
 //' @param PfT_v Variance estimates
 //' @param PpT_v Predicted variance estimates
+//' @param range Optional time range c(t0, t1) (1-based) to which the results are restricted
 //' @return List of smoothed estimates
 // [[Rcpp::export]]
 Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R,
                           arma::mat FT, arma::mat PT,
-                          Rcpp::NumericVector PfT_v, Rcpp::NumericVector PpT_v) {
+                          Rcpp::NumericVector PfT_v, Rcpp::NumericVector PpT_v,
+                          Rcpp::IntegerVector range) {
 
   const int T = FT.n_rows;
   const int rp = A.n_rows;
-  const int n = C.n_rows;
 
   cube PfT = array2cube(PfT_v);
   cube PpT = array2cube(PpT_v);
 
-  cube J(rp, rp, T, fill::zeros);
-  cube L(n, n, T, fill::zeros);
-  cube K(rp, n, T, fill::zeros);
+  // Smoothed states for a time window only, without the additional variables used in EM
+  int t0, t1;
+  if (checkRange(range, T, t0, t1)) {
+    mat FsT;
+    cube PsT;
+    KalmanSmoothRange(A, FT, PT, PfT, PpT, 0, t0, t1, FsT, PsT);
+    return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                              Rcpp::Named("Ps") = PsT);
+  }
 
+  cube J(rp, rp, T, fill::zeros);
   cube PsTm(rp, rp, T, fill::zeros);
 
   // Smoothed state mean and covariance
@@ -138,13 +373,10 @@ Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R,
 
   }
 
-  // Additional variables used in EM-algorithm
-  for (int i=0; i < T; ++i) {
-    L.slice(i) = (C * PpT.slice(i) * C.t() + R).i();
-    K.slice(i) = PpT.slice(i) * C.t() * L.slice(i);
-  }
+  // Additional variables used in EM-algorithm: only the gain of the last period is needed
+  const mat KT = PpT.slice(T-1) * C.t() * (C * PpT.slice(T-1) * C.t() + R).i();
 
-  PsTm.slice(T-1) = (eye(rp,rp) - K.slice(T-1) * C) * A * PfT.slice(T-2);
+  PsTm.slice(T-1) = (eye(rp,rp) - KT * C) * A * PfT.slice(T-2);
 
   for (int j=2; j < T-1; ++j) {
     PsTm.slice(T-j) = PfT.slice(T-j) * J.slice(T-j-1).t() + J.slice(T-j)
@@ -159,7 +391,42 @@ Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R,
 
 
 
-//' Kalman Filter and Smoother
+// Sequential (univariate) processing of a single observation x = c * f + e, e ~ N(0, r),
+// for diagonal R (Durbin and Koopman, 2000). Absorbs the observation into the filtered state
+// (f, P) with a rank-1 update in O(rp^2), and returns its log-likelihood contribution without
+// the constant -0.5 * log(2 * pi). Summing these over the observed cells of a row gives the
+// contribution of the row in KalmanFilter(). Skipped if the innovation variance is not positive.
+double KalmanUpdateCell(colvec& f, mat& P, const rowvec& c, double r, double x) {
+  const colvec Pc = P * c.t();
+  const double s = dot(c, Pc) + r;
+  if (!(s > 0)) return 0;
+  const double v = x - dot(c, f);
+  f += Pc * (v / s);
+  P -= Pc * (Pc.t() / s);
+  return -0.5 * (log(s) + v * v / s);
+}
+
+
+// Backward (RTS) pass over a window of filtered states Ff (rp x m) and covariances Pf,
+// recomputing the predictions from the transition equation. Used by the fixed-lag smoothers,
+// which only keep the last m filtered states in memory.
+void KalmanSmoothWindow(const mat& A, const mat& Q, const mat& Ff, const cube& Pf,
+                        mat& Fs, cube& Ps) {
+
+  const int m = Ff.n_cols;
+  mat Pp, J;
+  Fs = Ff;
+  Ps = Pf;
+  for (int t = m-2; t >= 0; --t) {
+    Pp = A * Pf.slice(t) * A.t() + Q;
+    J = Pf.slice(t) * A.t() * Pp.i();
+    Fs.col(t) = Ff.col(t) + J * (Fs.col(t+1) - A * Ff.col(t));
+    Ps.slice(t) = Pf.slice(t) + J * (Ps.slice(t+1) - Pp) * J.t();
+  }
+}
+
+
+//' Fixed-lag Kalman smoother
 //' @param X Data matrix (T x n)
 //' @param C Observation matrix
 //' @param Q State covariance
@@ -167,113 +434,623 @@ Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R,
 //' @param A Transition matrix
 //' @param F0 Initial state vector
 //' @param P0 Initial state covariance
+//' @param L Lag: the state at time t is smoothed with the data up to time t + L
+//' @return List with the fixed-lag smoothed states (T x rp), the smoothed covariances
+//' of the last L + 1 periods, and the log-likelihood
 // [[Rcpp::export]]
-Rcpp::List KalmanFilterSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
-                                arma::mat A, arma::colvec F0, arma::mat P0) {
+Rcpp::List KalmanFixedLag(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                          arma::mat A, arma::colvec F0, arma::mat P0, int L) {
 
   const int T = X.n_rows;
-  const int n = X.n_cols;
   const int rp = A.n_rows;
+  if (L < 0 || T < 1) Rcpp::stop("L must be non-negative and X must have at least one row");
+  const int W = std::min(L+1, T);
 
   double loglik = 0;
-  mat K, Pf, Pp;
-  colvec ff, fp, xe;
-  // Predicted state mean and covariance
-  mat PT(T+1, rp, fill::zeros);
-  cube PpT(rp, rp, T+1, fill::zeros);
+  mat Pf, Pp, Fs;
+  colvec ff, fp, fs;
+  cube Ps;
+  // Ring buffer of the last W filtered states and covariances, the predictions for the following
+  // periods and the smoother gains J_t = Pf_t A' Pp_{t+1}^-1, which only depend on the filter and
+  // are thus computed once per period
+  mat Fr(rp, W), Fpr(rp, W);
+  cube Pr(rp, rp, W), Ppr(rp, rp, W), Jr(rp, rp, W);
+  // Fixed-lag smoothed states
+  mat FsT(T, rp, fill::zeros);
 
-  // Filtered state mean and covariance
-  mat FT(T, rp, fill::zeros);
-  cube PfT(rp, rp, T, fill::zeros);
+  fp = F0;
+  Pp = P0;
+
+  for (int t=0; t < T; ++t) {
+
+    loglik += KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+
+    // Run a prediction
+    fp = A * ff;
+    Pp = A * Pf * A.t() + Q;
+
+    const int i = t % W;
+    Fr.col(i) = ff;
+    Pr.slice(i) = Pf;
+    Fpr.col(i) = fp;
+    Ppr.slice(i) = Pp;
+    Jr.slice(i) = Pf * A.t() * Pp.i();
+
+    // Smooth the window [t-W+1, t] backwards with the stored gains and keep the estimate for
+    // its first period. Covariances are only needed for the last window, where all periods are kept.
+    if (t >= W-1) {
+      const bool last = t == T-1;
+      fs = ff;
+      if (last) {
+        Fs.set_size(rp, W);
+        Ps.set_size(rp, rp, W);
+        Fs.col(W-1) = ff;
+        Ps.slice(W-1) = Pf;
+      }
+      for (int k = W-2; k >= 0; --k) {
+        const int j = (t-W+1+k) % W;
+        const mat& J = Jr.slice(j);
+        fs = Fr.col(j) + J * (fs - Fpr.col(j));
+        if (last) {
+          Fs.col(k) = fs;
+          Ps.slice(k) = Pr.slice(j) + J * (Ps.slice(k+1) - Ppr.slice(j)) * J.t();
+        }
+      }
+      if (!last) FsT.row(t-W+1) = fs.t();
+      else FsT.rows(T-W, T-1) = Fs.t();
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                            Rcpp::Named("Ps") = Ps,
+                            Rcpp::Named("loglik") = loglik);
+}
+
+
+//' Checkpointed Kalman Filter and Smoother with bounded memory
+//' @param X Data matrix (T x n)
+//' @param C Observation matrix
+//' @param Q State covariance
+//' @param R Observation covariance
+//' @param A Transition matrix
+//' @param F0 Initial state vector
+//' @param P0 Initial state covariance
+//' @param mem Memory budget (bytes) for the filter histories
+//' @param k Checkpoint interval (0 to choose it from the memory budget)
+//' @return List with the smoothed states (T x rp), their variances (T x rp), the log-likelihood and the checkpoint interval
+// [[Rcpp::export]]
+Rcpp::List KalmanCheckpointSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                    arma::mat A, arma::colvec F0, arma::mat P0,
+                                    double mem = 1e9, int k = 0) {
+
+  const int T = X.n_rows;
+  const int rp = A.n_rows;
+  if (T < 1) Rcpp::stop("X must have at least one row");
+
+  // Memory for one checkpoint (predicted state and covariance), and for one row of a
+  // recomputed segment (predicted and filtered states and covariances)
+  const double cbytes = 8.0 * (rp + rp*rp), sbytes = 2.0 * cbytes;
+  if (k <= 0) {
+    if (T * sbytes <= mem) k = T; // Everything fits: no recomputation
+    else {
+      k = std::max(1, (int)std::round(std::sqrt(T * cbytes / sbytes)));
+      if (std::ceil(double(T) / k) * cbytes + k * sbytes > mem)
+        Rcpp::warning("Memory budget too small, using the minimum memory checkpoint interval k = %d", k);
+    }
+  }
+  k = std::min(k, T);
+  const int nseg = (T + k - 1) / k;
+
+  double loglik = 0;
+  colvec fp = F0, ff;
+  mat Pp = P0, Pf;
+
+  // Checkpoints: predicted state and covariance at the start of each segment
+  mat Fc(rp, nseg);
+  cube Pc(rp, rp, nseg);
+  // Segment buffers
+  mat Fpk(rp, k), Ffk(rp, k);
+  cube Ppk(rp, rp, k), Pfk(rp, rp, k);
+
+  // Forward pass storing checkpoints (and the filter output if there is only one segment)
+  for (int t=0; t < T; ++t) {
+    if (t % k == 0) {
+      Fc.col(t / k) = fp;
+      Pc.slice(t / k) = Pp;
+    }
+    loglik += KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+    if (nseg == 1) {
+      Fpk.col(t) = fp;
+      Ppk.slice(t) = Pp;
+      Ffk.col(t) = ff;
+      Pfk.slice(t) = Pf;
+    }
+    // Run a prediction
+    fp = A * ff;
+    Pp = A * Pf * A.t() + Q;
+  }
+
+  // Backward pass over the segments, recomputing the filter in each from its checkpoint
+  mat FsT(T, rp), VsT(T, rp), J;
+  colvec Fs;
+  mat Ps;
+  for (int j = nseg-1; j >= 0; --j) {
+    const int start = j * k, end = std::min(T, start + k) - 1;
+    if (nseg > 1) {
+      fp = Fc.col(j);
+      Pp = Pc.slice(j);
+      for (int t = start; t <= end; ++t) {
+        KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+        Fpk.col(t-start) = fp;
+        Ppk.slice(t-start) = Pp;
+        Ffk.col(t-start) = ff;
+        Pfk.slice(t-start) = Pf;
+        fp = A * ff;
+        Pp = A * Pf * A.t() + Q;
+      }
+    }
+    for (int t = end; t >= start; --t) {
+      const int i = t - start;
+      if (t == T-1) {
+        Fs = Ffk.col(i);
+        Ps = Pfk.slice(i);
+      } else {
+        // Predicted state for t+1: from the segment, or the checkpoint of the next segment
+        const bool next = t == end;
+        const colvec fp1 = next ? Fc.col(j+1) : Fpk.col(i+1);
+        const mat& Pp1 = next ? Pc.slice(j+1) : Ppk.slice(i+1);
+        J = Pfk.slice(i) * A.t() * Pp1.i();
+        Fs = Ffk.col(i) + J * (Fs - fp1);
+        Ps = Pfk.slice(i) + J * (Ps - Pp1) * J.t();
+      }
+      FsT.row(t) = Fs.t();
+      VsT.row(t) = Ps.diag().t();
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                            Rcpp::Named("Vs") = VsT,
+                            Rcpp::Named("loglik") = loglik,
+                            Rcpp::Named("k") = k);
+}
+
+
+//' Kalman Filter and Smoother with out-of-core covariance storage
+//' @param X Data matrix (T x n)
+//' @param C Observation matrix
+//' @param Q State covariance
+//' @param R Observation covariance
+//' @param A Transition matrix
+//' @param F0 Initial state vector
+//' @param P0 Initial state covariance
+//' @param dir Scratch directory for the memory-mapped files
+//' @param keep Keep the file with the smoothed covariances (rp x rp x T doubles) and return its path?
+//' @return List with the smoothed states (T x rp), their variances (T x rp), the log-likelihood,
+//' and the path and dimensions of the file with the smoothed covariances (if keep = TRUE)
+// [[Rcpp::export]]
+Rcpp::List KalmanFilterSmootherMapped(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                      arma::mat A, arma::colvec F0, arma::mat P0,
+                                      std::string dir, bool keep = false) {
+
+  const int T = X.n_rows;
+  const int rp = A.n_rows;
+  if (T < 1) Rcpp::stop("X must have at least one row");
+
+  // Predicted and filtered covariances are written sequentially in the forward pass
+  // and read in reverse in the backward pass. The smoothed ones are only stored if kept.
+  MappedCube PpT(rp, rp, T, dir), PfT(rp, rp, T, dir), PsT(rp, rp, keep ? T : 0, dir, keep);
+  if (!PpT.mapped() || !PfT.mapped() || (keep && !PsT.mapped()))
+    Rcpp::warning("Could not create memory-mapped files in '%s', using memory instead", dir);
+  PpT.sequential();
+  PfT.sequential();
+
+  double loglik = 0;
+  colvec fp = F0, ff;
+  mat Pp = P0, Pf;
+  mat PT(T, rp), FT(T, rp);
+
+  for (int t=0; t < T; ++t) {
+    loglik += KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+    PT.row(t) = fp.t();
+    FT.row(t) = ff.t();
+    std::copy(Pp.begin(), Pp.end(), PpT.slice(t));
+    std::copy(Pf.begin(), Pf.end(), PfT.slice(t));
+    // Run a prediction
+    fp = A * ff;
+    Pp = A * Pf * A.t() + Q;
+  }
+
+  // Backward pass in chunks of about 64MB: prefetch the next chunk and release the last one
+  const int chunk = std::max(1, (int)((64 << 20) / (rp * rp * sizeof(double))));
+  mat FsT(T, rp), VsT(T, rp), J;
+  rowvec Fs = FT.row(T-1);
+  mat Ps(PfT.slice(T-1), rp, rp);
+
+  for (int t = T-1; ; --t) {
+    if ((T-1-t) % chunk == 0) {
+      const int lo = std::max(0, t+1-chunk);
+      PfT.willneed(lo, t+1);
+      PpT.willneed(lo, t+2);
+      PfT.dontneed(t+1, t+1+chunk);
+      PpT.dontneed(t+2, t+2+chunk);
+      if (keep) PsT.dontneed(t+1, t+1+chunk);
+    }
+    FsT.row(t) = Fs;
+    VsT.row(t) = Ps.diag().t();
+    if (keep) std::copy(Ps.begin(), Ps.end(), PsT.slice(t));
+    if (t == 0) break;
+    const mat Pft(PfT.slice(t-1), rp, rp, false, true), Ppt(PpT.slice(t), rp, rp, false, true);
+    J = Pft * A.t() * Ppt.i();
+    Fs = FT.row(t-1) + (J * (Fs - PT.row(t)).t()).t();
+    Ps = Pft + J * (Ps - Ppt) * J.t();
+  }
 
-  mat tC = C;
-  mat tR = R;
+  if (keep && PsT.mapped()) {
+    PsT.sync();
+    return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                              Rcpp::Named("Vs") = VsT,
+                              Rcpp::Named("loglik") = loglik,
+                              Rcpp::Named("Ps_file") = PsT.path(),
+                              Rcpp::Named("Ps_dim") = Rcpp::IntegerVector::create(rp, rp, T));
+  }
+  return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                            Rcpp::Named("Vs") = VsT,
+                            Rcpp::Named("loglik") = loglik);
+}
+
+
+// Lower triangular factor L with L L' = B B' for an n x k matrix B with k >= n,
+// from the QR decomposition of B' (L = R')
+static mat triFactor(const mat& B) {
+  mat Qm, Rm;
+  qr_econ(Qm, Rm, B.t());
+  return Rm.t();
+}
+
+// Lower triangular square root of a positive semi-definite matrix, M = S S': the Cholesky factor, or
+// if M is singular (e.g. the state covariance of a companion form), the triangularized square root
+// from the eigendecomposition (negative eigenvalues due to rounding are set to zero)
+static mat sqrtFactor(const mat& M) {
+  if (M.is_diagmat()) return diagmat(sqrt(clamp(colvec(M.diag()), 0, datum::inf)));
   mat S;
-  uvec miss;
-  uvec nmiss = find_finite(A.row(0));
-  uvec a(1);
+  if (chol(S, symmatu(M), "lower")) return S;
+  colvec d;
+  mat V;
+  eig_sym(d, V, symmatu(M));
+  return triFactor(V * diagmat(sqrt(clamp(d, 0, datum::inf))));
+}
 
-  fp = F0;
-  Pp = P0;
+
+// Square-root Kalman filter and smoother without calls into the R API, so that it can also
+// run the E-step of the EM algorithm. Fills the smoothed states, covariances and lag-one
+// covariances (PsTm) and returns the log-likelihood.
+double KalmanFilterSmootherSqrtCore(const mat& X, const mat& C, const mat& Q, const mat& R,
+                                    const mat& A, const colvec& F0, const mat& P0,
+                                    mat& FsT, cube& PsT, cube& PsTm) {
+
+  const int T = X.n_rows;
+  const int n = X.n_cols;
+  const int rp = A.n_rows;
+
+  const mat Sq = sqrtFactor(Q);
+  const bool diagR = R.is_diagmat();
+
+  double loglik = 0;
+  colvec fp = F0, ff, xe, z;
+  mat Sp = sqrtFactor(P0), Sf, M, post;
+  // Predicted and filtered states and Cholesky factors of their covariances
+  mat PT(T, rp), FT(T, rp);
+  cube SpT(rp, rp, T), SfT(rp, rp, T);
+  uvec a(1);
 
   for (int t=0; t < T; ++t) {
 
-    // If missing observations are present at some timepoints, exclude the
-    // appropriate matrix slices from the filtering procedure.
-    miss = find_finite(X.row(t));
-    C = tC.submat(miss, nmiss);
-    R = tR.submat(miss, miss);
+    const uvec miss = find_finite(X.row(t));
+    const int m = miss.n_elem;
     a[0] = t;
+    PT.row(t) = fp.t();
+    SpT.slice(t) = Sp;
 
-    S = (C * Pp * C.t() + R).i();
-
-    // Prediction error
-    xe = X.submat(a, miss).t() - C * fp;
-    // Kalman gain
-    K = Pp * C.t() * S;
-    // Updated state estimate
-    ff = fp + K * xe;
-    // Updated state covariance estimate
-    Pf = Pp - K * C * Pp;
-
-    // Compute likelihood. Skip this part if S is not positive definite.
-    if (det(S) > 0) {
-      loglik += -0.5 * (double(n) * log(2.0 * datum::pi) - log(det(S)) +
-        conv_to<double>::from(xe.t() * S * xe));
+    if (m == 0) {
+      ff = fp;
+      Sf = Sp;
+      loglik += -0.5 * double(n) * log(2.0 * datum::pi);
+    } else {
+      // Measurement update: triangularizing [Sr, C Sp; 0, Sp] gives [Se, 0; K Se, Sf],
+      // with Se Se' the innovation covariance and Sf Sf' the filtered state covariance
+      const mat Ct = C.rows(miss);
+      M.zeros(m+rp, m+rp);
+      M.submat(0, 0, m-1, m-1) = diagR ? mat(diagmat(sqrt(colvec(R.diag())(miss)))) : sqrtFactor(R.submat(miss, miss));
+      M.submat(0, m, m-1, m+rp-1) = Ct * Sp;
+      M.submat(m, m, m+rp-1, m+rp-1) = Sp;
+      post = triFactor(M);
+      const mat Se = post.submat(0, 0, m-1, m-1);
+      Sf = post.submat(m, m, m+rp-1, m+rp-1);
+      // Prediction error, standardized with the innovation factor
+      xe = X.submat(a, miss).t() - Ct * fp;
+      z = solve(trimatl(Se), xe);
+      ff = fp + post.submat(m, 0, m+rp-1, m-1) * z;
+      const double logdet = 2.0 * accu(log(abs(Se.diag())));
+      // Skip this part if S is singular
+      if (std::isfinite(logdet)) loglik += -0.5 * (double(n) * log(2.0 * datum::pi) + logdet + dot(z, z));
     }
 
-    // Store predicted and filtered data needed for smoothing
-    PT.row(t) = fp.t();
-    PpT.slice(t) = Pp;
     FT.row(t) = ff.t();
-    PfT.slice(t) = Pf;
+    SfT.slice(t) = Sf;
 
-    // Run a prediction
-    fp = A * FT.row(t).t();
-    Pp = A * PfT.slice(t) * A.t() + Q;
+    // Time update: triangularize [A Sf, Sq]
+    fp = A * ff;
+    Sp = triFactor(join_rows(A * Sf, Sq));
+  }
+
+  // Smoother, with the covariances in Joseph form (I - J A) Pf (I - J A)' + J Q J' + J Ps J',
+  // propagated as square roots
+  FsT.set_size(T, rp);
+  PsT.set_size(rp, rp, T);
+  PsTm.zeros(rp, rp, T);
+  colvec fs = FT.row(T-1).t();
+  mat Ss = SfT.slice(T-1), J;
+  const mat I = eye(rp, rp);
+  FsT.row(T-1) = fs.t();
+  PsT.slice(T-1) = Ss * Ss.t();
+
+  for (int t = T-2; t >= 0; --t) {
+    const mat& Sft = SfT.slice(t);
+    const mat& Sp1 = SpT.slice(t+1);
+    // J = Pf A' Pp^-1 with Pp = Sp1 Sp1'
+    J = solve(trimatu(Sp1.t()), solve(trimatl(Sp1), A * Sft * Sft.t())).t();
+    fs = FT.row(t).t() + J * (fs - PT.row(t+1).t());
+    Ss = triFactor(join_rows(join_rows((I - J * A) * Sft, J * Sq), J * Ss));
+    FsT.row(t) = fs.t();
+    PsT.slice(t) = Ss * Ss.t();
+    // Lag-one covariance Cov(F_t+1, F_t) used in the EM algorithm
+    PsTm.slice(t+1) = PsT.slice(t+1) * J.t();
   }
 
+  return loglik;
+}
+
+//' Square-root Kalman Filter and Smoother
+//' @param X Data matrix (T x n)
+//' @param C Observation matrix
+//' @param Q State covariance
+//' @param R Observation covariance
+//' @param A Transition matrix
+//' @param F0 Initial state vector
+//' @param P0 Initial state covariance
+// [[Rcpp::export]]
+Rcpp::List KalmanFilterSmootherSqrt(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                    arma::mat A, arma::colvec F0, arma::mat P0) {
+
+  if (X.n_rows < 1) Rcpp::stop("X must have at least one row");
+
+  mat FsT;
+  cube PsT, PsTm;
+  const double loglik = KalmanFilterSmootherSqrtCore(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm);
+  return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                            Rcpp::Named("Ps") = PsT,
+                            Rcpp::Named("PsTm") = PsTm,
+                            Rcpp::Named("loglik") = loglik);
+}
+
+
+// Kalman filter and smoother without any calls into the R API, so that it can
+// also be run from worker threads. Fills the smoothed states and covariances
+// and returns the log-likelihood. em = false skips the lag-one covariances
+// (PsTm) only needed in the EM algorithm, which also allows T = 1. The covariance
+// histories are stored in full cubes, or packed (SymCube) if PsT is packed, and in
+// single precision if PsT is an fcube or fSymCube. The filter recursion itself and
+// all products are always computed in double precision.
+template <class Store>
+static double KalmanFilterSmootherCoreT(mat X, mat C, mat Q, mat R,
+                                        const mat& A, const colvec& F0, const mat& P0,
+                                        mat& FsT, Store& PsT, cube& PsTm, bool em) {
+
+  const int T = X.n_rows;
+  const int rp = A.n_rows;
+
+  double loglik;
+  // Predicted state mean and covariance
+  mat PT(T+1, rp, fill::zeros);
+  Store PpT;
+  initSlices(PpT, rp, T+1);
+
+  // Filtered state mean and covariance
+  mat FT(T, rp, fill::zeros);
+  Store PfT;
+  initSlices(PfT, rp, T);
+
+  // Small models with diagonal R use the fixed-size kernels
+  if (!KalmanFilterFixedDispatch(X, C, R, A, Q, F0, P0, PT, PpT, FT, PfT, loglik))
+    loglik = KalmanFilterGeneral(X, C, R, A, Q, F0, P0, PT, PpT, FT, PfT);
+
   // Kamlman Smoother
-  cube J(rp, rp, T, fill::zeros);
-  cube L(n, n, T, fill::zeros);
-  cube KS(rp, n, T, fill::zeros);
-  cube PsTm(rp, rp, T, fill::zeros);
+  // The gains are kept in double precision also with single precision stores
+  cube J;
+  initSlices(J, rp, T);
+  PsTm.zeros(rp, rp, T);
 
   // Smoothed state mean and covariance
-  mat FsT(T, rp, fill::zeros);
-  cube PsT(rp, rp, T, fill::zeros);
+  FsT.zeros(T, rp);
+  initSlices(PsT, rp, T);
+  // Buffers for slices of packed or single precision stores
+  mat Bf, Bp, Bs, Bj, Bj1;
   // Initialize smoothed data with last observation of filtered data
   FsT.row(T-1) = FT.row(T-1);
-  PsT.slice(T-1) = PfT.slice(T-1);
+  setSlice(PsT, T-1, getSlice(PfT, T-1, Bf));
 
   // cube PsTm(rp,rp,T, fill::zeros);
   for (int t=0; t < T-1; ++t) {
-    J.slice(t) = PfT.slice(t) * A.t() * PpT.slice(t+1).i();
+    setSlice(J, t, getSlice(PfT, t, Bf) * A.t() * getSlice(PpT, t+1, Bp).i());
   }
 
   // Smoothed state variable and covariance
   for (int j=2; j < T+1; ++j) {
 
+    const mat& Jt = getSlice(J, T-j, Bj);
     FsT.row(T-j) = FT.row(T-j) +
-      (J.slice(T-j) * (FsT.row(T-j+1) - PT.row(T-j+1)).t()).t();
+      (Jt * (FsT.row(T-j+1) - PT.row(T-j+1)).t()).t();
 
-    PsT.slice(T-j) = PfT.slice(T-j) +
-      J.slice(T-j) * (PsT.slice(T-j+1) - PpT.slice(T-j+1)) * J.slice(T-j).t();
+    setSlice(PsT, T-j, getSlice(PfT, T-j, Bf) +
+      Jt * (getSlice(PsT, T-j+1, Bs) - getSlice(PpT, T-j+1, Bp)) * Jt.t());
 
   }
 
-  // Additional variables used in EM-algorithm
-  for (int i=0; i < T; ++i) {
-    L.slice(i) = (C * PpT.slice(i) * C.t() + R).i();
-    KS.slice(i) = PpT.slice(i) * C.t() * L.slice(i);
-  }
+  if (!em) return loglik;
+
+  // Additional variables used in EM-algorithm: only the gain of the last period is
+  // needed, computed with the observation matrices of that period
+  const uvec obs = find_finite(X.row(T-1));
+  const mat CT = C.rows(obs);
+  const mat& PpTm1 = getSlice(PpT, T-1, Bp);
+  const mat KT = PpTm1 * CT.t() * (CT * PpTm1 * CT.t() + R.submat(obs, obs)).i();
 
-  PsTm.slice(T-1) = (eye(rp,rp) - KS.slice(T-1) * C) * A * PfT.slice(T-2);
+  PsTm.slice(T-1) = (eye(rp,rp) - KT * CT) * A * getSlice(PfT, T-2, Bf);
 
   for (int j=2; j < T-1; ++j) {
-    PsTm.slice(T-j) = PfT.slice(T-j) * J.slice(T-j-1).t() + J.slice(T-j)
-    * (PsTm.slice(T-j+1) - A * PfT.slice(T-j))
-    * J.slice(T-j-1).t();
+    const mat& Jt1 = getSlice(J, T-j-1, Bj1);
+    const mat& Pft = getSlice(PfT, T-j, Bf);
+    PsTm.slice(T-j) = Pft * Jt1.t() + getSlice(J, T-j, Bj)
+    * (PsTm.slice(T-j+1) - A * Pft)
+    * Jt1.t();
+  }
+
+  return loglik;
+}
+
+double KalmanFilterSmootherCore(mat X, mat C, mat Q, mat R,
+                                const mat& A, const colvec& F0, const mat& P0,
+                                mat& FsT, cube& PsT, cube& PsTm, bool em) {
+  return KalmanFilterSmootherCoreT(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm, em);
+}
+
+double KalmanFilterSmootherCore(mat X, mat C, mat Q, mat R,
+                                const mat& A, const colvec& F0, const mat& P0,
+                                mat& FsT, SymCube& PsT, cube& PsTm, bool em) {
+  return KalmanFilterSmootherCoreT(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm, em);
+}
+
+double KalmanFilterSmootherCore(mat X, mat C, mat Q, mat R,
+                                const mat& A, const colvec& F0, const mat& P0,
+                                mat& FsT, fcube& PsT, cube& PsTm, bool em) {
+  return KalmanFilterSmootherCoreT(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm, em);
+}
+
+double KalmanFilterSmootherCore(mat X, mat C, mat Q, mat R,
+                                const mat& A, const colvec& F0, const mat& P0,
+                                mat& FsT, fSymCube& PsT, cube& PsTm, bool em) {
+  return KalmanFilterSmootherCoreT(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm, em);
+}
+
+
+// Kalman filter storing filtered and predicted states only from time t0 onwards,
+// followed by the smoother restricted to [t0, t1]. Returns the log-likelihood.
+static double KalmanFilterSmootherRange(mat X, mat C, mat Q, mat R,
+                                        const mat& A, const colvec& F0, const mat& P0,
+                                        int t0, int t1, mat& FsT, cube& PsT) {
+
+  const int T = X.n_rows;
+  const int rp = A.n_rows;
+
+  double loglik = 0;
+  mat Pf, Pp;
+  colvec ff, fp;
+  // Predicted and filtered state means and covariances from t0 onwards
+  mat PT(T-t0, rp);
+  cube PpT(rp, rp, T-t0);
+  mat FT(T-t0, rp);
+  cube PfT(rp, rp, T-t0);
+
+  fp = F0;
+  Pp = P0;
+
+  for (int t=0; t < T; ++t) {
+
+    loglik += KalmanFilterStep(X, t, C, R, fp, Pp, ff, Pf);
+
+    if (t >= t0) {
+      PT.row(t-t0) = fp.t();
+      PpT.slice(t-t0) = Pp;
+      FT.row(t-t0) = ff.t();
+      PfT.slice(t-t0) = Pf;
+    }
+
+    // Run a prediction
+    fp = A * ff;
+    Pp = A * Pf * A.t() + Q;
+  }
+
+  KalmanSmoothRange(A, FT, PT, PfT, PpT, t0, t0, t1, FsT, PsT);
+  return loglik;
+}
+
+
+//' Kalman Filter and Smoother
+//' @param X Data matrix (T x n)
+//' @param C Observation matrix
+//' @param Q State covariance
+//' @param R Observation covariance
+//' @param A Transition matrix
+//' @param F0 Initial state vector
+//' @param P0 Initial state covariance
+//' @param range Optional time range c(t0, t1) (1-based) to which the smoothed results are restricted
+//' (only with full double precision storage)
+//' @param packed Store the covariance histories in packed symmetric form (expanded on return)
+//' @param single Store the covariance histories in single precision (computations remain in double)
+//' @param check With single = true, also run in double precision and report the maximum absolute deviations
+// [[Rcpp::export]]
+Rcpp::List KalmanFilterSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                arma::mat A, arma::colvec F0, arma::mat P0,
+                                Rcpp::IntegerVector range, bool packed = false,
+                                bool single = false, bool check = false) {
+
+  if (check && !single) Rcpp::stop("check = TRUE requires single precision storage");
+  int t0, t1;
+  if (checkRange(range, X.n_rows, t0, t1)) {
+    // The range-restricted smoother only keeps the window in memory
+    if (packed || single) Rcpp::stop("range cannot be combined with packed or single precision storage");
+    mat FsT;
+    cube PsT;
+    double loglik = KalmanFilterSmootherRange(X, C, Q, R, A, F0, P0, t0, t1, FsT, PsT);
+    return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                              Rcpp::Named("Ps") = PsT,
+                              Rcpp::Named("loglik") = loglik);
+  }
+
+  mat FsT;
+  cube PsT, PsTm;
+  double loglik;
+  if (single) {
+    if (packed) {
+      fSymCube PsTp;
+      loglik = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, FsT, PsTp, PsTm);
+      PsT = PsTp.expand();
+    } else {
+      fcube PsTf;
+      loglik = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, FsT, PsTf, PsTm);
+      PsT = conv_to<cube>::from(PsTf);
+    }
+  } else if (packed) {
+    SymCube PsTp;
+    loglik = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, FsT, PsTp, PsTm);
+    PsT = PsTp.expand();
+  } else loglik = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, FsT, PsT, PsTm);
+
+  if (single && check) {
+    // Error of the single precision run against the double precision one
+    mat FsD;
+    cube PsD, PsTmD;
+    double loglikD = KalmanFilterSmootherCore(X, C, Q, R, A, F0, P0, FsD, PsD, PsTmD);
+    Rcpp::NumericVector error = Rcpp::NumericVector::create(
+      Rcpp::Named("Fs") = max(vectorise(abs(FsT - FsD))),
+      Rcpp::Named("Ps") = max(vectorise(abs(PsT - PsD))),
+      Rcpp::Named("PsTm") = max(vectorise(abs(PsTm - PsTmD))),
+      Rcpp::Named("loglik") = std::abs(loglik - loglikD));
+    return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
+                              Rcpp::Named("Ps") = PsT,
+                              Rcpp::Named("PsTm") = PsTm,
+                              Rcpp::Named("loglik") = loglik,
+                              Rcpp::Named("error") = error);
   }
 
   return Rcpp::List::create(Rcpp::Named("Fs") = FsT,
@@ -3,7 +3,40 @@ Rcpp::List KalmanFilter(arma::mat y, arma::mat F, arma::mat Q, arma::mat R,
 
 Rcpp::List KalmanSmoother(arma::mat A, arma::mat F, arma::mat R,
                           arma::mat xitt, arma::mat xittm,
-                          Rcpp::NumericVector Ptt1, Rcpp::NumericVector Pttm1);
+                          Rcpp::NumericVector Ptt1, Rcpp::NumericVector Pttm1,
+                          Rcpp::IntegerVector range);
 
 Rcpp::List KalmanFilterSmoother(arma::mat y, arma::mat C, arma::mat Q, arma::mat R,
-                                arma::mat A, arma::colvec F0, arma::mat P0);
+                                arma::mat A, arma::colvec F0, arma::mat P0,
+                                Rcpp::IntegerVector range, bool packed, bool single, bool check);
+
+double KalmanFilterSmootherCore(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                const arma::mat& A, const arma::colvec& F0, const arma::mat& P0,
+                                arma::mat& FsT, arma::cube& PsT, arma::cube& PsTm, bool em = true);
+
+// Same with the smoothed (and internally the predicted and filtered) covariances in packed storage,
+// and in single precision storage (full or packed)
+template <class eT> class SymCubeT;
+typedef SymCubeT<double> SymCube;
+typedef SymCubeT<float> fSymCube;
+double KalmanFilterSmootherCore(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                const arma::mat& A, const arma::colvec& F0, const arma::mat& P0,
+                                arma::mat& FsT, SymCube& PsT, arma::cube& PsTm, bool em = true);
+double KalmanFilterSmootherCore(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                const arma::mat& A, const arma::colvec& F0, const arma::mat& P0,
+                                arma::mat& FsT, arma::fcube& PsT, arma::cube& PsTm, bool em = true);
+double KalmanFilterSmootherCore(arma::mat X, arma::mat C, arma::mat Q, arma::mat R,
+                                const arma::mat& A, const arma::colvec& F0, const arma::mat& P0,
+                                arma::mat& FsT, fSymCube& PsT, arma::cube& PsTm, bool em = true);
+
+double KalmanFilterSmootherSqrtCore(const arma::mat& X, const arma::mat& C, const arma::mat& Q, const arma::mat& R,
+                                    const arma::mat& A, const arma::colvec& F0, const arma::mat& P0,
+                                    arma::mat& FsT, arma::cube& PsT, arma::cube& PsTm);
+
+double KalmanFilterStep(const arma::mat& X, int t, const arma::mat& C, const arma::mat& R,
+                        const arma::colvec& fp, const arma::mat& Pp, arma::colvec& ff, arma::mat& Pf);
+
+double KalmanUpdateCell(arma::colvec& f, arma::mat& P, const arma::rowvec& c, double r, double x);
+
+void KalmanSmoothWindow(const arma::mat& A, const arma::mat& Q, const arma::mat& Ff, const arma::cube& Pf,
+                        arma::mat& Fs, arma::cube& Ps);
@@ -0,0 +1,150 @@
+#ifndef DFM_KALMANFIXED_H
+#define DFM_KALMANFIXED_H
+
+#include <cmath>
+#include <limits>
+
+// Kalman filter kernels for a state dimension N fixed at compile time (N <= KALMAN_FIXED_MAX), and a
+// diagonal observation covariance R. All N x N matrices are column-major arrays on the stack, so that
+// the loops have compile-time bounds and are unrolled, avoiding the overhead of dynamic Armadillo
+// matrices and BLAS calls, which dominates the filter loops for small models. The loadings of the
+// series are the columns of Ct (N x n), and rinv holds the inverse variances 1 / diag(R).
+#define KALMAN_FIXED_MAX 8
+
+template <int N>
+struct KalmanFixed {
+
+  // Information matrix G = C'R^-1 C of all series
+  static void info(const double* Ct, const double* rinv, int n, double* G) {
+    for (int k = 0; k < N * N; ++k) G[k] = 0;
+    for (int i = 0; i < n; ++i) {
+      const double* c = Ct + i * N;
+      for (int j = 0; j < N; ++j) {
+        const double wc = rinv[i] * c[j];
+        for (int k = 0; k < N; ++k) G[k + j * N] += c[k] * wc;
+      }
+    }
+  }
+
+  // Measurement update with the observed (finite) elements of x, in information form: with
+  // b = C'R^-1 e and G = C'R^-1 C over the observed series, Pf = (I + Pp G)^-1 Pp and
+  // ff = fp + Pf b, as S^-1 = R^-1 - R^-1 C Pf C'R^-1. Gfull and logrfull = log det R are
+  // used for complete rows. Returns log det S + e'S^-1 e, or NaN if S is not positive definite.
+  static double update(const double* Ct, const double* rinv, const double* x, int n,
+                       const double* Gfull, double logrfull,
+                       const double* fp, const double* Pp, double* ff, double* Pf) {
+
+    double b[N], G[N * N];
+    double quad = 0, logr = 0;
+    int nobs = 0;
+    for (int k = 0; k < N; ++k) b[k] = 0;
+    for (int i = 0; i < n; ++i) {
+      if (!std::isfinite(x[i])) continue;
+      const double* c = Ct + i * N;
+      double e = x[i];
+      for (int k = 0; k < N; ++k) e -= c[k] * fp[k];
+      const double we = rinv[i] * e;
+      for (int k = 0; k < N; ++k) b[k] += c[k] * we;
+      quad += we * e;
+      logr -= std::log(rinv[i]);
+      ++nobs;
+    }
+    if (nobs == 0) {
+      for (int k = 0; k < N; ++k) ff[k] = fp[k];
+      for (int k = 0; k < N * N; ++k) Pf[k] = Pp[k];
+      return 0;
+    }
+    if (nobs == n) {
+      for (int k = 0; k < N * N; ++k) G[k] = Gfull[k];
+      logr = logrfull;
+    } else {
+      for (int k = 0; k < N * N; ++k) G[k] = 0;
+      for (int i = 0; i < n; ++i) {
+        if (!std::isfinite(x[i])) continue;
+        const double* c = Ct + i * N;
+        for (int j = 0; j < N; ++j) {
+          const double wc = rinv[i] * c[j];
+          for (int k = 0; k < N; ++k) G[k + j * N] += c[k] * wc;
+        }
+      }
+    }
+
+    // M = I + Pp G, then solve M Pf = Pp by Gaussian elimination with partial pivoting
+    double M[N * N], B[N * N];
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) {
+        double s = i == j ? 1.0 : 0.0;
+        for (int k = 0; k < N; ++k) s += Pp[i + k * N] * G[k + j * N];
+        M[i + j * N] = s;
+        B[i + j * N] = Pp[i + j * N];
+      }
+    double det = 1;
+    for (int k = 0; k < N; ++k) {
+      int p = k;
+      double amax = std::abs(M[k + k * N]);
+      for (int i = k + 1; i < N; ++i)
+        if (std::abs(M[i + k * N]) > amax) { amax = std::abs(M[i + k * N]); p = i; }
+      if (amax == 0) {
+        for (int i = 0; i < N; ++i) ff[i] = fp[i];
+        for (int i = 0; i < N * N; ++i) Pf[i] = Pp[i];
+        return std::numeric_limits<double>::quiet_NaN();
+      }
+      if (p != k) {
+        for (int j = 0; j < N; ++j) {
+          double tmp = M[k + j * N]; M[k + j * N] = M[p + j * N]; M[p + j * N] = tmp;
+          tmp = B[k + j * N]; B[k + j * N] = B[p + j * N]; B[p + j * N] = tmp;
+        }
+        det = -det;
+      }
+      const double piv = M[k + k * N];
+      det *= piv;
+      for (int i = k + 1; i < N; ++i) {
+        const double l = M[i + k * N] / piv;
+        for (int j = k + 1; j < N; ++j) M[i + j * N] -= l * M[k + j * N];
+        for (int j = 0; j < N; ++j) B[i + j * N] -= l * B[k + j * N];
+      }
+    }
+    for (int j = 0; j < N; ++j)
+      for (int i = N - 1; i >= 0; --i) {
+        double s = B[i + j * N];
+        for (int k = i + 1; k < N; ++k) s -= M[i + k * N] * B[k + j * N];
+        B[i + j * N] = s / M[i + i * N];
+      }
+
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) Pf[i + j * N] = 0.5 * (B[i + j * N] + B[j + i * N]);
+    for (int i = 0; i < N; ++i) {
+      double s = 0;
+      for (int k = 0; k < N; ++k) s += Pf[i + k * N] * b[k];
+      ff[i] = fp[i] + s;
+      quad -= b[i] * s;
+    }
+    if (det <= 0) return std::numeric_limits<double>::quiet_NaN();
+    return std::log(det) + logr + quad;
+  }
+
+  // Time update fp = A ff, Pp = A Pf A' + Q
+  static void predict(const double* A, const double* Q, const double* ff, const double* Pf,
+                      double* fp, double* Pp) {
+    double AP[N * N];
+    for (int i = 0; i < N; ++i) {
+      double s = 0;
+      for (int k = 0; k < N; ++k) s += A[i + k * N] * ff[k];
+      fp[i] = s;
+    }
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) {
+        double s = 0;
+        for (int k = 0; k < N; ++k) s += A[i + k * N] * Pf[k + j * N];
+        AP[i + j * N] = s;
+      }
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < N; ++i) {
+        double s = Q[i + j * N];
+        for (int k = 0; k < N; ++k) s += AP[i + k * N] * A[j + k * N];
+        Pp[i + j * N] = s;
+      }
+  }
+};
+
+#endif
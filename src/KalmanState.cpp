@@ -0,0 +1,283 @@
+#include <RcppArmadillo.h>
+#include <vector>
+#include "KalmanFiltering.h"
+
+// [[Rcpp::depends(RcppArmadillo)]]
+using namespace arma;
+
+
+// Persistent Kalman filter state for incremental (online) filtering. Holds the system
+// matrices, the predicted state mean and covariance for the next row, the accumulated
+// log-likelihood, and a ring buffer of the predicted states before the last nbuf rows,
+// so that the filter can be rewound to absorb data revisions. Single cells can also be
+// absorbed one at a time into an open row, which is closed before the next prediction.
+struct KalmanStateData {
+  mat A, C, Q, R;
+  colvec rinv;  // inverse observation error variances if R is diagonal (else empty)
+  colvec fp;
+  mat Pp;
+  double loglik;
+  uword t;
+  // Open row: filtered state with the cells absorbed so far, and their log-likelihood
+  bool open;
+  colvec ff;
+  mat Pf;
+  double rowll;
+  // Ring buffer: slot t % nbuf holds the state before row t was pushed
+  uword nbuf, nsnap;
+  std::vector<colvec> bF;
+  std::vector<mat> bP;
+  std::vector<double> bL;
+  // Fixed-lag smoothing: slot t % lag holds the filtered state of row t, for the last nlag rows
+  uword lag, nlag;
+  mat lF;
+  cube lP;
+};
+
+static KalmanStateData* getState(SEXP state) {
+  Rcpp::XPtr<KalmanStateData> s(state);
+  if (!s.get()) Rcpp::stop("Invalid Kalman filter state (external pointers do not survive saving and reloading)");
+  return s.get();
+}
+
+// Store the predicted state before row t in the ring buffer
+static void snapshot(KalmanStateData& s) {
+  if (!s.nbuf) return;
+  const uword k = s.t % s.nbuf;
+  s.bF[k] = s.fp;
+  s.bP[k] = s.Pp;
+  s.bL[k] = s.loglik;
+  if (s.nsnap < s.nbuf) ++s.nsnap;
+}
+
+// Add the log-likelihood contribution of row t and run a prediction for row t + 1
+static void closeRow(KalmanStateData& s, const colvec& ff, const mat& Pf, double ll) {
+  if (s.lag) {
+    s.lF.col(s.t % s.lag) = ff;
+    s.lP.slice(s.t % s.lag) = Pf;
+    if (s.nlag < s.lag) ++s.nlag;
+  }
+  s.loglik += ll;
+  s.fp = s.A * ff;
+  s.Pp = s.A * Pf * s.A.t() + s.Q;
+  s.open = false;
+  ++s.t;
+}
+
+// Filtering update with the finite cells of x. With diagonal R the information form is used:
+// with G = C'R^-1 C and b = C'R^-1 e, Pf = (I + Pp G)^-1 Pp and ff = fp + Pf b, which costs
+// O(rp^3 + n_obs rp^2) instead of inverting the n_obs x n_obs innovation covariance.
+// Returns the log-likelihood contribution of the row, computed as in KalmanFilter().
+static double stateUpdate(const KalmanStateData& s, const rowvec& x, colvec& ff, mat& Pf) {
+  const double ll0 = -0.5 * double(x.n_elem) * log(2.0 * datum::pi);
+  const uvec obs = find_finite(x);
+  if (obs.n_elem == 0) {
+    ff = s.fp;
+    Pf = s.Pp;
+    return ll0;
+  }
+  const uword rp = s.fp.n_elem;
+  const mat Co = s.C.rows(obs);
+  const colvec e = x.cols(obs).t() - Co * s.fp;
+  double logdet, sign, quad;
+  if (s.rinv.n_elem) {
+    const colvec ri = s.rinv(obs);
+    const mat CtRi = Co.t() * diagmat(ri);
+    const colvec b = CtRi * e;
+    const mat M = eye(rp, rp) + s.Pp * (CtRi * Co);
+    Pf = solve(M, s.Pp);
+    Pf = 0.5 * (Pf + Pf.t());
+    ff = s.fp + Pf * b;
+    log_det(logdet, sign, M);
+    logdet -= accu(log(ri));
+    quad = dot(e % ri, e) - dot(b, Pf * b);
+  } else {
+    const mat CP = Co * s.Pp;
+    const mat S = symmatu(CP * Co.t() + s.R.submat(obs, obs));
+    const mat K = solve(S, CP).t();
+    ff = s.fp + K * e;
+    Pf = s.Pp - K * CP;
+    Pf = 0.5 * (Pf + Pf.t());
+    log_det(logdet, sign, S);
+    quad = dot(e, solve(S, e));
+  }
+  // Skip this part if S is not positive definite.
+  return sign > 0 ? ll0 - 0.5 * (logdet + quad) : 0;
+}
+
+
+//' Create a persistent Kalman filter state
+//' @param C Observation matrix
+//' @param Q State covariance
+//' @param R Observation covariance
+//' @param A Transition matrix
+//' @param F0 Initial state vector
+//' @param P0 Initial state covariance
+//' @param nrewind Number of rows that can be rewound
+//' @param lag Number of most recent rows for which smoothed states can be obtained
+// [[Rcpp::export]]
+SEXP KalmanState(arma::mat C, arma::mat Q, arma::mat R, arma::mat A,
+                 arma::colvec F0, arma::mat P0, int nrewind = 12, int lag = 0) {
+  const uword rp = A.n_rows;
+  if (A.n_cols != rp || C.n_cols != rp || Q.n_rows != rp || P0.n_rows != rp || F0.n_elem != rp || R.n_rows != C.n_rows)
+    Rcpp::stop("Non-conformable system matrices");
+  KalmanStateData* s = new KalmanStateData;
+  s->A = A; s->C = C; s->Q = Q; s->R = R;
+  if (R.is_diagmat() && all(R.diag() > 0)) s->rinv = 1.0 / R.diag();
+  s->fp = F0;
+  s->Pp = P0;
+  s->loglik = 0;
+  s->t = 0;
+  s->open = false;
+  s->nbuf = nrewind > 0 ? nrewind : 0;
+  s->nsnap = 0;
+  s->bF.resize(s->nbuf);
+  s->bP.resize(s->nbuf);
+  s->bL.resize(s->nbuf);
+  s->lag = lag > 0 ? lag : 0;
+  s->nlag = 0;
+  s->lF.set_size(rp, s->lag);
+  s->lP.set_size(rp, rp, s->lag);
+  Rcpp::XPtr<KalmanStateData> ptr(s, true);
+  ptr.attr("class") = "KalmanState";
+  return ptr;
+}
+
+//' Push new rows of data into a Kalman filter state
+//' @param state Kalman filter state created with KalmanState()
+//' @param X Data matrix (m x n) of new rows, NA where not observed
+//' @return List with the filtered states (m x rp) and covariance of the last row, and the accumulated log-likelihood.
+//' A row opened with KalmanStateAbsorb() is closed first.
+// [[Rcpp::export]]
+Rcpp::List KalmanStateUpdate(SEXP state, const arma::mat& X) {
+  KalmanStateData& s = *getState(state);
+  const uword m = X.n_rows, rp = s.fp.n_elem;
+  if (X.n_cols != s.C.n_rows) Rcpp::stop("Number of columns of X must match the number of rows of the observation matrix");
+  mat FT(m, rp);
+  colvec ff;
+  mat Pf = s.Pp;
+  if (s.open) closeRow(s, s.ff, s.Pf, s.rowll - 0.5 * double(X.n_cols) * log(2.0 * datum::pi));
+  for (uword i = 0; i < m; ++i) {
+    snapshot(s);
+    const double ll = stateUpdate(s, X.row(i), ff, Pf);
+    FT.row(i) = ff.t();
+    closeRow(s, ff, Pf, ll);
+  }
+  return Rcpp::List::create(Rcpp::Named("F") = FT,
+                            Rcpp::Named("Pf") = Pf,
+                            Rcpp::Named("loglik") = s.loglik);
+}
+
+//' Absorb single observations into the current row of a Kalman filter state
+//' @param state Kalman filter state created with KalmanState() with a diagonal observation covariance
+//' @param i Series (1-based) of the observations
+//' @param x Observed values
+//' @return List with the filtered state and covariance of the current (open) row
+// [[Rcpp::export]]
+Rcpp::List KalmanStateAbsorb(SEXP state, Rcpp::IntegerVector i, Rcpp::NumericVector x) {
+  KalmanStateData& s = *getState(state);
+  const int n = s.C.n_rows, m = i.size();
+  if (!s.rinv.n_elem) Rcpp::stop("Sequential updates require a diagonal observation covariance R with positive elements");
+  if (x.size() != m) Rcpp::stop("i and x must have the same length");
+  for (int k = 0; k < m; ++k) if (i[k] == NA_INTEGER || i[k] < 1 || i[k] > n) Rcpp::stop("Invalid series index");
+  if (!s.open) {
+    snapshot(s);
+    s.ff = s.fp;
+    s.Pf = s.Pp;
+    s.rowll = 0;
+    s.open = true;
+  }
+  for (int k = 0; k < m; ++k) {
+    if (!std::isfinite(x[k])) continue;
+    s.rowll += KalmanUpdateCell(s.ff, s.Pf, s.C.row(i[k] - 1), 1.0 / s.rinv[i[k] - 1], x[k]);
+  }
+  return Rcpp::List::create(Rcpp::Named("F") = s.ff,
+                            Rcpp::Named("Pf") = s.Pf);
+}
+
+//' Close the current row of a Kalman filter state and predict the next one
+//' @param state Kalman filter state created with KalmanState()
+//' @return List with the filtered state and covariance of the closed row, and the accumulated log-likelihood
+// [[Rcpp::export]]
+Rcpp::List KalmanStateClose(SEXP state) {
+  KalmanStateData& s = *getState(state);
+  if (!s.open) {
+    snapshot(s);
+    s.ff = s.fp;
+    s.Pf = s.Pp;
+    s.rowll = 0;
+  }
+  const colvec ff = s.ff;
+  const mat Pf = s.Pf;
+  closeRow(s, ff, Pf, s.rowll - 0.5 * double(s.C.n_rows) * log(2.0 * datum::pi));
+  return Rcpp::List::create(Rcpp::Named("F") = ff,
+                            Rcpp::Named("Pf") = Pf,
+                            Rcpp::Named("loglik") = s.loglik);
+}
+
+//' Rewind a Kalman filter state
+//' @param state Kalman filter state created with KalmanState()
+//' @param k Number of rows to rewind (at most the nrewind passed to KalmanState()). An open row is discarded first.
+// [[Rcpp::export]]
+int KalmanStateRewind(SEXP state, int k = 1) {
+  KalmanStateData& s = *getState(state);
+  if (s.open) { // Predicted state is unchanged, only drop its snapshot
+    s.open = false;
+    if (s.nsnap) --s.nsnap;
+  }
+  if (k < 0 || (uword)k > s.nsnap) Rcpp::stop("Can rewind at most %d rows", (int)s.nsnap);
+  if (k == 0) return s.t;
+  const uword j = (s.t - k) % s.nbuf;
+  s.fp = s.bF[j];
+  s.Pp = s.bP[j];
+  s.loglik = s.bL[j];
+  s.t -= k;
+  s.nsnap -= k;
+  s.nlag = s.nlag > (uword)k ? s.nlag - k : 0;
+  return s.t;
+}
+
+//' Fixed-lag smoothed states of the most recent rows of a Kalman filter state
+//' @param state Kalman filter state created with KalmanState() with lag > 0
+//' @return List with the first row t of the window (1-based), and the smoothed states (m x rp) and covariances (rp x rp x m)
+//' of the last m <= lag closed rows, followed by the open row if any
+// [[Rcpp::export]]
+Rcpp::List KalmanStateSmooth(SEXP state) {
+  KalmanStateData& s = *getState(state);
+  if (!s.lag) Rcpp::stop("Smoothing requires a Kalman filter state created with lag > 0");
+  const uword rp = s.fp.n_elem, m = s.nlag + s.open;
+  mat Ff(rp, m), Fs;
+  cube Pf(rp, rp, m), Ps;
+  for (uword k = 0; k < s.nlag; ++k) {
+    const uword j = (s.t - s.nlag + k) % s.lag;
+    Ff.col(k) = s.lF.col(j);
+    Pf.slice(k) = s.lP.slice(j);
+  }
+  if (s.open) {
+    Ff.col(m-1) = s.ff;
+    Pf.slice(m-1) = s.Pf;
+  }
+  if (m) KalmanSmoothWindow(s.A, s.Q, Ff, Pf, Fs, Ps);
+  else {
+    Fs = Ff;
+    Ps = Pf;
+  }
+  return Rcpp::List::create(Rcpp::Named("t") = (int)(s.t - s.nlag + 1),
+                            Rcpp::Named("Fs") = Fs.t(),
+                            Rcpp::Named("Ps") = Ps);
+}
+
+//' Inspect a Kalman filter state
+//' @param state Kalman filter state created with KalmanState()
+//' @return List with the number of rows pushed, the predicted state and covariance for the next row,
+//' the accumulated log-likelihood, the number of rows that can be rewound, and whether a row is open
+// [[Rcpp::export]]
+Rcpp::List KalmanStateInfo(SEXP state) {
+  KalmanStateData& s = *getState(state);
+  return Rcpp::List::create(Rcpp::Named("t") = (int)s.t,
+                            Rcpp::Named("F") = s.fp,
+                            Rcpp::Named("P") = s.Pp,
+                            Rcpp::Named("loglik") = s.loglik,
+                            Rcpp::Named("nrewind") = (int)s.nsnap,
+                            Rcpp::Named("open") = s.open);
+}
@@ -0,0 +1,98 @@
+#include "MappedCube.h"
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+// Allocates the blocks of the file, so that running out of disk space is detected here rather than
+// raising SIGBUS on a store through the mapping (as with a sparse file from ftruncate())
+static bool reserveFile(int fd, size_t bytes) {
+#ifdef __APPLE__
+  fstore_t st = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)bytes, 0};
+  if (fcntl(fd, F_PREALLOCATE, &st) == -1) return false;
+  return ftruncate(fd, (off_t)bytes) == 0;
+#else
+  return posix_fallocate(fd, 0, (off_t)bytes) == 0;
+#endif
+}
+#endif
+
+MappedCube::MappedCube(size_t n_rows, size_t n_cols, size_t n_slices, const std::string& dir, bool keep_file) :
+  slice_elem(n_rows * n_cols), nslices(n_slices), bytes(n_rows * n_cols * n_slices * sizeof(double)),
+  mem(NULL), map(false), keep(keep_file) {
+
+#ifndef _WIN32
+  if (!dir.empty() && bytes > 0) {
+    std::string tmpl = dir + "/DFM_cube_XXXXXX";
+    std::vector<char> name(tmpl.begin(), tmpl.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if (fd >= 0) {
+      if (reserveFile(fd, bytes)) {
+        void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+          mem = static_cast<double*>(p);
+          map = true;
+        }
+      }
+      close(fd); // The mapping keeps the file open
+      // Without keep the file is removed right away, and its blocks freed on unmapping
+      if (map && keep) file = &name[0];
+      else unlink(&name[0]);
+    }
+  }
+#endif
+  if (!map) {
+    keep = false;
+    heap.resize(n_rows * n_cols * n_slices);
+    mem = heap.empty() ? NULL : &heap[0];
+  }
+}
+
+MappedCube::~MappedCube() {
+#ifndef _WIN32
+  if (map) munmap(mem, bytes);
+#endif
+}
+
+void MappedCube::advise(size_t first, size_t last, int how) {
+#ifndef _WIN32
+  if (!map || first >= last) return;
+  if (last > nslices) last = nslices;
+  // posix_madvise() requires a page-aligned start address
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t from = first * slice_elem * sizeof(double), to = last * slice_elem * sizeof(double);
+  from -= from % page;
+  posix_madvise((char*)mem + from, to - from, how);
+#else
+  (void)first; (void)last; (void)how;
+#endif
+}
+
+void MappedCube::sequential() {
+#ifndef _WIN32
+  advise(0, nslices, POSIX_MADV_SEQUENTIAL);
+#endif
+}
+
+void MappedCube::willneed(size_t first, size_t last) {
+#ifndef _WIN32
+  advise(first, last, POSIX_MADV_WILLNEED);
+#endif
+}
+
+void MappedCube::dontneed(size_t first, size_t last) {
+#ifndef _WIN32
+  advise(first, last, POSIX_MADV_DONTNEED);
+#endif
+}
+
+void MappedCube::sync() {
+#ifndef _WIN32
+  if (map) msync(mem, bytes, MS_SYNC);
+#endif
+}
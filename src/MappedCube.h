@@ -0,0 +1,43 @@
+#ifndef DFM_MAPPEDCUBE_H
+#define DFM_MAPPEDCUBE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Storage for an n_rows x n_cols x n_slices array of doubles (column-major, like arma::cube),
+// optionally backed by a memory-mapped file in a scratch directory so that it need not be
+// resident in RAM. The space of the file is reserved up front. Falls back to heap memory if the
+// file cannot be created or reserved (e.g. a full disk), or mapping is not supported (Windows).
+// Slices are accessed through pointers, e.g. arma::mat S(cube.slice(t), n_rows, n_cols, false, true).
+class MappedCube {
+public:
+  // dir = "" always uses heap memory. keep = true keeps the file after destruction.
+  MappedCube(size_t n_rows, size_t n_cols, size_t n_slices, const std::string& dir = "", bool keep = false);
+  ~MappedCube();
+
+  double* slice(size_t i) { return mem + i * slice_elem; }
+  size_t n_slices() const { return nslices; }
+  bool mapped() const { return map; }
+  const std::string& path() const { return file; }
+
+  // Page cache hints for slices [first, last)
+  void sequential();
+  void willneed(size_t first, size_t last);
+  void dontneed(size_t first, size_t last);
+  // Write mapped pages back to the file
+  void sync();
+
+private:
+  MappedCube(const MappedCube&);
+  MappedCube& operator=(const MappedCube&);
+  void advise(size_t first, size_t last, int how);
+
+  size_t slice_elem, nslices, bytes;
+  double* mem;
+  bool map, keep;
+  std::string file;
+  std::vector<double> heap;
+};
+
+#endif
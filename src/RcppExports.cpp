@@ -12,8 +12,8 @@ Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
 // Estep
-Rcpp::List Estep(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0);
-RcppExport SEXP _DFM_Estep(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP) {
+Rcpp::List Estep(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, bool single, bool packed, bool sqroot);
+RcppExport SEXP _DFM_Estep(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP singleSEXP, SEXP packedSEXP, SEXP sqrootSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -24,7 +24,344 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
     Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
     Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
-    rcpp_result_gen = Rcpp::wrap(Estep(X, C, Q, R, A, F0, P0));
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< bool >::type packed(packedSEXP);
+    Rcpp::traits::input_parameter< bool >::type sqroot(sqrootSEXP);
+    rcpp_result_gen = Rcpp::wrap(Estep(X, C, Q, R, A, F0, P0, single, packed, sqroot));
+    return rcpp_result_gen;
+END_RCPP
+}
+// EMDGRmultistart
+Rcpp::List EMDGRmultistart(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, arma::mat cpX, int T, int r, int rQi, int rRi, int min_iter, int max_iter, double tol, int nstart, double perturb, int seed, int nthreads, bool single, bool packed, bool sqroot);
+RcppExport SEXP _DFM_EMDGRmultistart(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP cpXSEXP, SEXP TSEXP, SEXP rSEXP, SEXP rQiSEXP, SEXP rRiSEXP, SEXP min_iterSEXP, SEXP max_iterSEXP, SEXP tolSEXP, SEXP nstartSEXP, SEXP perturbSEXP, SEXP seedSEXP, SEXP nthreadsSEXP, SEXP singleSEXP, SEXP packedSEXP, SEXP sqrootSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type cpX(cpXSEXP);
+    Rcpp::traits::input_parameter< int >::type T(TSEXP);
+    Rcpp::traits::input_parameter< int >::type r(rSEXP);
+    Rcpp::traits::input_parameter< int >::type rQi(rQiSEXP);
+    Rcpp::traits::input_parameter< int >::type rRi(rRiSEXP);
+    Rcpp::traits::input_parameter< int >::type min_iter(min_iterSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iter(max_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    Rcpp::traits::input_parameter< int >::type nstart(nstartSEXP);
+    Rcpp::traits::input_parameter< double >::type perturb(perturbSEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< bool >::type packed(packedSEXP);
+    Rcpp::traits::input_parameter< bool >::type sqroot(sqrootSEXP);
+    rcpp_result_gen = Rcpp::wrap(EMDGRmultistart(X, C, Q, R, A, F0, P0, cpX, T, r, rQi, rRi, min_iter, max_iter, tol, nstart, perturb, seed, nthreads, single, packed, sqroot));
+    return rcpp_result_gen;
+END_RCPP
+}
+// EMDGRgrid
+Rcpp::List EMDGRgrid(arma::mat X, arma::mat X_imp, arma::mat v, Rcpp::IntegerVector rs, Rcpp::IntegerVector ps, int T, int rQi, int rRi, int min_iter, int max_iter, double tol, int nthreads);
+RcppExport SEXP _DFM_EMDGRgrid(SEXP XSEXP, SEXP X_impSEXP, SEXP vSEXP, SEXP rsSEXP, SEXP psSEXP, SEXP TSEXP, SEXP rQiSEXP, SEXP rRiSEXP, SEXP min_iterSEXP, SEXP max_iterSEXP, SEXP tolSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type X_imp(X_impSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type v(vSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type rs(rsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type ps(psSEXP);
+    Rcpp::traits::input_parameter< int >::type T(TSEXP);
+    Rcpp::traits::input_parameter< int >::type rQi(rQiSEXP);
+    Rcpp::traits::input_parameter< int >::type rRi(rRiSEXP);
+    Rcpp::traits::input_parameter< int >::type min_iter(min_iterSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iter(max_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(EMDGRgrid(X, X_imp, v, rs, ps, T, rQi, rRi, min_iter, max_iter, tol, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ICrBatch
+Rcpp::List ICrBatch(Rcpp::List panels, int rmax, int nthreads);
+RcppExport SEXP _DFM_ICrBatch(SEXP panelsSEXP, SEXP rmaxSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type panels(panelsSEXP);
+    Rcpp::traits::input_parameter< int >::type rmax(rmaxSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ICrBatch(panels, rmax, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// companionPowers
+arma::mat companionPowers(const arma::mat& A, int h);
+RcppExport SEXP _DFM_companionPowers(SEXP ASEXP, SEXP hSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< int >::type h(hSEXP);
+    rcpp_result_gen = Rcpp::wrap(companionPowers(A, h));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMforecast
+Rcpp::List DFMforecast(const arma::mat& Apow, const arma::mat& C, const arma::mat& F, int h);
+RcppExport SEXP _DFM_DFMforecast(SEXP ApowSEXP, SEXP CSEXP, SEXP FSEXP, SEXP hSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type Apow(ApowSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type F(FSEXP);
+    Rcpp::traits::input_parameter< int >::type h(hSEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMforecast(Apow, C, F, h));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMforecastVar
+Rcpp::List DFMforecastVar(const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R, arma::mat P, int h, bool full);
+RcppExport SEXP _DFM_DFMforecastVar(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP PSEXP, SEXP hSEXP, SEXP fullSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P(PSEXP);
+    Rcpp::traits::input_parameter< int >::type h(hSEXP);
+    Rcpp::traits::input_parameter< bool >::type full(fullSEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMforecastVar(A, Q, C, R, P, h, full));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMsimulate
+Rcpp::NumericVector DFMsimulate(const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R, const arma::mat& F, const arma::mat& P, int h, int N, const arma::colvec& center, const arma::colvec& scale, const arma::colvec& probs, const arma::mat& VA, Rcpp::NumericVector VC, double seed, int nthreads);
+RcppExport SEXP _DFM_DFMsimulate(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP FSEXP, SEXP PSEXP, SEXP hSEXP, SEXP NSEXP, SEXP centerSEXP, SEXP scaleSEXP, SEXP probsSEXP, SEXP VASEXP, SEXP VCSEXP, SEXP seedSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type R(RSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type F(FSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type P(PSEXP);
+    Rcpp::traits::input_parameter< int >::type h(hSEXP);
+    Rcpp::traits::input_parameter< int >::type N(NSEXP);
+    Rcpp::traits::input_parameter< const arma::colvec& >::type center(centerSEXP);
+    Rcpp::traits::input_parameter< const arma::colvec& >::type scale(scaleSEXP);
+    Rcpp::traits::input_parameter< const arma::colvec& >::type probs(probsSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type VA(VASEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type VC(VCSEXP);
+    Rcpp::traits::input_parameter< double >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMsimulate(A, Q, C, R, F, P, h, N, center, scale, probs, VA, VC, seed, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMscenarioBatch
+Rcpp::List DFMscenarioBatch(const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R, const arma::mat& F, const arma::mat& P, Rcpp::NumericVector X, int nthreads);
+RcppExport SEXP _DFM_DFMscenarioBatch(SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP FSEXP, SEXP PSEXP, SEXP XSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type R(RSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type F(FSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type P(PSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type X(XSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMscenarioBatch(A, Q, C, R, F, P, X, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMedge
+Rcpp::List DFMedge(const arma::mat& X, const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R, const arma::colvec& F0, const arma::mat& P0);
+RcppExport SEXP _DFM_DFMedge(SEXP XSEXP, SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP F0SEXP, SEXP P0SEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type R(RSEXP);
+    Rcpp::traits::input_parameter< const arma::colvec& >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type P0(P0SEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMedge(X, A, Q, C, R, F0, P0));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DFMnewsCore
+Rcpp::List DFMnewsCore(const arma::mat& Xo, const arma::mat& Xn, const arma::mat& A, const arma::mat& Q, const arma::mat& C, const arma::mat& R, Rcpp::List edge, int target, int t_target);
+RcppExport SEXP _DFM_DFMnewsCore(SEXP XoSEXP, SEXP XnSEXP, SEXP ASEXP, SEXP QSEXP, SEXP CSEXP, SEXP RSEXP, SEXP edgeSEXP, SEXP targetSEXP, SEXP t_targetSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type Xo(XoSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Xn(XnSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type A(ASEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type C(CSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type R(RSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type edge(edgeSEXP);
+    Rcpp::traits::input_parameter< int >::type target(targetSEXP);
+    Rcpp::traits::input_parameter< int >::type t_target(t_targetSEXP);
+    rcpp_result_gen = Rcpp::wrap(DFMnewsCore(Xo, Xn, A, Q, C, R, edge, target, t_target));
+    return rcpp_result_gen;
+END_RCPP
+}
+// impNA_EMPCA
+arma::mat impNA_EMPCA(arma::mat X, int r, int maxit, double tol);
+RcppExport SEXP _DFM_impNA_EMPCA(SEXP XSEXP, SEXP rSEXP, SEXP maxitSEXP, SEXP tolSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< int >::type r(rSEXP);
+    Rcpp::traits::input_parameter< int >::type maxit(maxitSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    rcpp_result_gen = Rcpp::wrap(impNA_EMPCA(X, r, maxit, tol));
+    return rcpp_result_gen;
+END_RCPP
+}
+// impNA_median
+Rcpp::NumericMatrix impNA_median(Rcpp::NumericMatrix X, Rcpp::RawVector W, int nthreads);
+RcppExport SEXP _DFM_impNA_median(SEXP XSEXP, SEXP WSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type W(WSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(impNA_median(X, W, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// impNA_MA
+Rcpp::NumericMatrix impNA_MA(Rcpp::NumericMatrix X, Rcpp::RawVector W, int k, int nthreads);
+RcppExport SEXP _DFM_impNA_MA(SEXP XSEXP, SEXP WSEXP, SEXP kSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type W(WSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(impNA_MA(X, W, k, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// impNA_spline
+Rcpp::NumericMatrix impNA_spline(Rcpp::NumericMatrix X, Rcpp::RawVector W, int k, int nthreads);
+RcppExport SEXP _DFM_impNA_spline(SEXP XSEXP, SEXP WSEXP, SEXP kSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type W(WSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(impNA_spline(X, W, k, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// prepNA
+Rcpp::List prepNA(Rcpp::NumericMatrix X, double max_missing, bool scale, int nthreads);
+RcppExport SEXP _DFM_prepNA(SEXP XSEXP, SEXP max_missingSEXP, SEXP scaleSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< double >::type max_missing(max_missingSEXP);
+    Rcpp::traits::input_parameter< bool >::type scale(scaleSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(prepNA(X, max_missing, scale, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// unpackNA
+Rcpp::LogicalMatrix unpackNA(Rcpp::RawVector M);
+RcppExport SEXP _DFM_unpackNA(SEXP MSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type M(MSEXP);
+    rcpp_result_gen = Rcpp::wrap(unpackNA(M));
+    return rcpp_result_gen;
+END_RCPP
+}
+// maskRows
+Rcpp::RawVector maskRows(Rcpp::RawVector M, Rcpp::IntegerVector rm);
+RcppExport SEXP _DFM_maskRows(SEXP MSEXP, SEXP rmSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type M(MSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type rm(rmSEXP);
+    rcpp_result_gen = Rcpp::wrap(maskRows(M, rm));
+    return rcpp_result_gen;
+END_RCPP
+}
+// setNA
+Rcpp::NumericMatrix setNA(Rcpp::NumericMatrix X, Rcpp::RawVector M, Rcpp::NumericVector value);
+RcppExport SEXP _DFM_setNA(SEXP XSEXP, SEXP MSEXP, SEXP valueSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type M(MSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type value(valueSEXP);
+    rcpp_result_gen = Rcpp::wrap(setNA(X, M, value));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanFilterBatch
+Rcpp::List KalmanFilterBatch(Rcpp::List models, int nthreads);
+RcppExport SEXP _DFM_KalmanFilterBatch(SEXP modelsSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type models(modelsSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFilterBatch(models, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanFilterKernel
+SEXP KalmanFilterKernel(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, std::string kernel);
+RcppExport SEXP _DFM_KalmanFilterKernel(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP kernelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel(kernelSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFilterKernel(X, C, Q, R, A, F0, P0, kernel));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanKernelInfo
+Rcpp::DataFrame KalmanKernelInfo();
+RcppExport SEXP _DFM_KalmanKernelInfo() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(KalmanKernelInfo());
     return rcpp_result_gen;
 END_RCPP
 }
@@ -46,8 +383,8 @@ BEGIN_RCPP
 END_RCPP
 }
 // KalmanSmoother
-Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R, arma::mat FT, arma::mat PT, Rcpp::NumericVector PfT_v, Rcpp::NumericVector PpT_v);
-RcppExport SEXP _DFM_KalmanSmoother(SEXP ASEXP, SEXP CSEXP, SEXP RSEXP, SEXP FTSEXP, SEXP PTSEXP, SEXP PfT_vSEXP, SEXP PpT_vSEXP) {
+Rcpp::List KalmanSmoother(arma::mat A, arma::mat C, arma::mat R, arma::mat FT, arma::mat PT, Rcpp::NumericVector PfT_v, Rcpp::NumericVector PpT_v, Rcpp::IntegerVector range);
+RcppExport SEXP _DFM_KalmanSmoother(SEXP ASEXP, SEXP CSEXP, SEXP RSEXP, SEXP FTSEXP, SEXP PTSEXP, SEXP PfT_vSEXP, SEXP PpT_vSEXP, SEXP rangeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -58,13 +395,87 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< arma::mat >::type PT(PTSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type PfT_v(PfT_vSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type PpT_v(PpT_vSEXP);
-    rcpp_result_gen = Rcpp::wrap(KalmanSmoother(A, C, R, FT, PT, PfT_v, PpT_v));
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type range(rangeSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanSmoother(A, C, R, FT, PT, PfT_v, PpT_v, range));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanFixedLag
+Rcpp::List KalmanFixedLag(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, int L);
+RcppExport SEXP _DFM_KalmanFixedLag(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP LSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< int >::type L(LSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFixedLag(X, C, Q, R, A, F0, P0, L));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanCheckpointSmoother
+Rcpp::List KalmanCheckpointSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, double mem, int k);
+RcppExport SEXP _DFM_KalmanCheckpointSmoother(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP memSEXP, SEXP kSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< double >::type mem(memSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanCheckpointSmoother(X, C, Q, R, A, F0, P0, mem, k));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanFilterSmootherMapped
+Rcpp::List KalmanFilterSmootherMapped(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, std::string dir, bool keep);
+RcppExport SEXP _DFM_KalmanFilterSmootherMapped(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP dirSEXP, SEXP keepSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< std::string >::type dir(dirSEXP);
+    Rcpp::traits::input_parameter< bool >::type keep(keepSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFilterSmootherMapped(X, C, Q, R, A, F0, P0, dir, keep));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanFilterSmootherSqrt
+Rcpp::List KalmanFilterSmootherSqrt(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0);
+RcppExport SEXP _DFM_KalmanFilterSmootherSqrt(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type X(XSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFilterSmootherSqrt(X, C, Q, R, A, F0, P0));
     return rcpp_result_gen;
 END_RCPP
 }
 // KalmanFilterSmoother
-Rcpp::List KalmanFilterSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0);
-RcppExport SEXP _DFM_KalmanFilterSmoother(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP) {
+Rcpp::List KalmanFilterSmoother(arma::mat X, arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, Rcpp::IntegerVector range, bool packed, bool single, bool check);
+RcppExport SEXP _DFM_KalmanFilterSmoother(SEXP XSEXP, SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP rangeSEXP, SEXP packedSEXP, SEXP singleSEXP, SEXP checkSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -75,7 +486,99 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
     Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
     Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
-    rcpp_result_gen = Rcpp::wrap(KalmanFilterSmoother(X, C, Q, R, A, F0, P0));
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type range(rangeSEXP);
+    Rcpp::traits::input_parameter< bool >::type packed(packedSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< bool >::type check(checkSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanFilterSmoother(X, C, Q, R, A, F0, P0, range, packed, single, check));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanState
+SEXP KalmanState(arma::mat C, arma::mat Q, arma::mat R, arma::mat A, arma::colvec F0, arma::mat P0, int nrewind, int lag);
+RcppExport SEXP _DFM_KalmanState(SEXP CSEXP, SEXP QSEXP, SEXP RSEXP, SEXP ASEXP, SEXP F0SEXP, SEXP P0SEXP, SEXP nrewindSEXP, SEXP lagSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::mat >::type C(CSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type Q(QSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type R(RSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type A(ASEXP);
+    Rcpp::traits::input_parameter< arma::colvec >::type F0(F0SEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type P0(P0SEXP);
+    Rcpp::traits::input_parameter< int >::type nrewind(nrewindSEXP);
+    Rcpp::traits::input_parameter< int >::type lag(lagSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanState(C, Q, R, A, F0, P0, nrewind, lag));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateUpdate
+Rcpp::List KalmanStateUpdate(SEXP state, const arma::mat& X);
+RcppExport SEXP _DFM_KalmanStateUpdate(SEXP stateSEXP, SEXP XSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type X(XSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateUpdate(state, X));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateAbsorb
+Rcpp::List KalmanStateAbsorb(SEXP state, Rcpp::IntegerVector i, Rcpp::NumericVector x);
+RcppExport SEXP _DFM_KalmanStateAbsorb(SEXP stateSEXP, SEXP iSEXP, SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type i(iSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateAbsorb(state, i, x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateClose
+Rcpp::List KalmanStateClose(SEXP state);
+RcppExport SEXP _DFM_KalmanStateClose(SEXP stateSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateClose(state));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateRewind
+int KalmanStateRewind(SEXP state, int k);
+RcppExport SEXP _DFM_KalmanStateRewind(SEXP stateSEXP, SEXP kSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateRewind(state, k));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateSmooth
+Rcpp::List KalmanStateSmooth(SEXP state);
+RcppExport SEXP _DFM_KalmanStateSmooth(SEXP stateSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateSmooth(state));
+    return rcpp_result_gen;
+END_RCPP
+}
+// KalmanStateInfo
+Rcpp::List KalmanStateInfo(SEXP state);
+RcppExport SEXP _DFM_KalmanStateInfo(SEXP stateSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type state(stateSEXP);
+    rcpp_result_gen = Rcpp::wrap(KalmanStateInfo(state));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -101,3 +604,18 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// arsvd
+Rcpp::List arsvd(const arma::mat& x, int k, int oversample, int power, int seed);
+RcppExport SEXP _DFM_arsvd(SEXP xSEXP, SEXP kSEXP, SEXP oversampleSEXP, SEXP powerSEXP, SEXP seedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    Rcpp::traits::input_parameter< int >::type oversample(oversampleSEXP);
+    Rcpp::traits::input_parameter< int >::type power(powerSEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    rcpp_result_gen = Rcpp::wrap(arsvd(x, k, oversample, power, seed));
+    return rcpp_result_gen;
+END_RCPP
+}
@@ -0,0 +1,147 @@
+#include "SmallKernels.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// The x86 variants need GCC or clang (function target attributes and __builtin_cpu_supports). They are
+// disabled on Windows, where the stack is not aligned for spilled AVX registers.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+#define SK_X86 1
+#include <immintrin.h>
+#endif
+
+// Portable variant on plain arrays, vectorised by the compiler where possible
+namespace sk_generic {
+#define SK_ATTR
+struct vd { double v[SK_LD]; };
+inline vd vzero() { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = 0; return r; }
+inline vd vload(const double* p) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = p[i]; return r; }
+inline void vstore(double* p, const vd& a) { for (int i = 0; i < SK_LD; ++i) p[i] = a.v[i]; }
+inline vd vset1(double a) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = a; return r; }
+inline vd vadd(const vd& a, const vd& b) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = a.v[i] + b.v[i]; return r; }
+inline vd vmul(const vd& a, const vd& b) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = a.v[i] * b.v[i]; return r; }
+inline vd vfmadd(const vd& a, const vd& b, const vd& c) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = a.v[i] * b.v[i] + c.v[i]; return r; }
+inline vd vfnmadd(const vd& a, const vd& b, const vd& c) { vd r; for (int i = 0; i < SK_LD; ++i) r.v[i] = c.v[i] - a.v[i] * b.v[i]; return r; }
+inline double vsum(const vd& a) { double s = 0; for (int i = 0; i < SK_LD; ++i) s += a.v[i]; return s; }
+#include "SmallKernelsImpl.h"
+#undef SK_ATTR
+static bool supported() { return true; }
+}
+
+#ifdef SK_X86
+
+static bool cpuSupports(int isa) {
+  __builtin_cpu_init();
+  switch (isa) {
+  case 0: return __builtin_cpu_supports("sse2");
+  case 1: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  default: return __builtin_cpu_supports("avx512f");
+  }
+}
+
+// SSE2: four registers per column
+namespace sk_sse2 {
+#define SK_ATTR __attribute__((target("sse2")))
+struct vd { __m128d v[4]; };
+SK_ATTR inline vd vzero() { vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_setzero_pd(); return r; }
+SK_ATTR inline vd vload(const double* p) { vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_loadu_pd(p + 2 * i); return r; }
+SK_ATTR inline void vstore(double* p, const vd& a) { for (int i = 0; i < 4; ++i) _mm_storeu_pd(p + 2 * i, a.v[i]); }
+SK_ATTR inline vd vset1(double a) { vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_set1_pd(a); return r; }
+SK_ATTR inline vd vadd(const vd& a, const vd& b) { vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_add_pd(a.v[i], b.v[i]); return r; }
+SK_ATTR inline vd vmul(const vd& a, const vd& b) { vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_mul_pd(a.v[i], b.v[i]); return r; }
+SK_ATTR inline vd vfmadd(const vd& a, const vd& b, const vd& c) {
+  vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_add_pd(_mm_mul_pd(a.v[i], b.v[i]), c.v[i]); return r;
+}
+SK_ATTR inline vd vfnmadd(const vd& a, const vd& b, const vd& c) {
+  vd r; for (int i = 0; i < 4; ++i) r.v[i] = _mm_sub_pd(c.v[i], _mm_mul_pd(a.v[i], b.v[i])); return r;
+}
+SK_ATTR inline double vsum(const vd& a) {
+  const __m128d s = _mm_add_pd(_mm_add_pd(a.v[0], a.v[1]), _mm_add_pd(a.v[2], a.v[3]));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+#include "SmallKernelsImpl.h"
+#undef SK_ATTR
+static bool supported() { return cpuSupports(0); }
+}
+
+// AVX2 with FMA: two registers per column
+namespace sk_avx2 {
+#define SK_ATTR __attribute__((target("avx2,fma")))
+struct vd { __m256d lo, hi; };
+SK_ATTR inline vd vzero() { vd r = { _mm256_setzero_pd(), _mm256_setzero_pd() }; return r; }
+SK_ATTR inline vd vload(const double* p) { vd r = { _mm256_loadu_pd(p), _mm256_loadu_pd(p + 4) }; return r; }
+SK_ATTR inline void vstore(double* p, const vd& a) { _mm256_storeu_pd(p, a.lo); _mm256_storeu_pd(p + 4, a.hi); }
+SK_ATTR inline vd vset1(double a) { vd r = { _mm256_set1_pd(a), _mm256_set1_pd(a) }; return r; }
+SK_ATTR inline vd vadd(const vd& a, const vd& b) { vd r = { _mm256_add_pd(a.lo, b.lo), _mm256_add_pd(a.hi, b.hi) }; return r; }
+SK_ATTR inline vd vmul(const vd& a, const vd& b) { vd r = { _mm256_mul_pd(a.lo, b.lo), _mm256_mul_pd(a.hi, b.hi) }; return r; }
+SK_ATTR inline vd vfmadd(const vd& a, const vd& b, const vd& c) {
+  vd r = { _mm256_fmadd_pd(a.lo, b.lo, c.lo), _mm256_fmadd_pd(a.hi, b.hi, c.hi) }; return r;
+}
+SK_ATTR inline vd vfnmadd(const vd& a, const vd& b, const vd& c) {
+  vd r = { _mm256_fnmadd_pd(a.lo, b.lo, c.lo), _mm256_fnmadd_pd(a.hi, b.hi, c.hi) }; return r;
+}
+SK_ATTR inline double vsum(const vd& a) {
+  const __m256d s = _mm256_add_pd(a.lo, a.hi);
+  const __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+#include "SmallKernelsImpl.h"
+#undef SK_ATTR
+static bool supported() { return cpuSupports(1); }
+}
+
+// AVX-512: one register per column
+namespace sk_avx512 {
+#define SK_ATTR __attribute__((target("avx512f")))
+typedef __m512d vd;
+SK_ATTR inline vd vzero() { return _mm512_setzero_pd(); }
+SK_ATTR inline vd vload(const double* p) { return _mm512_loadu_pd(p); }
+SK_ATTR inline void vstore(double* p, vd a) { _mm512_storeu_pd(p, a); }
+SK_ATTR inline vd vset1(double a) { return _mm512_set1_pd(a); }
+SK_ATTR inline vd vadd(vd a, vd b) { return _mm512_add_pd(a, b); }
+SK_ATTR inline vd vmul(vd a, vd b) { return _mm512_mul_pd(a, b); }
+SK_ATTR inline vd vfmadd(vd a, vd b, vd c) { return _mm512_fmadd_pd(a, b, c); }
+SK_ATTR inline vd vfnmadd(vd a, vd b, vd c) { return _mm512_fnmadd_pd(a, b, c); }
+SK_ATTR inline double vsum(vd a) {
+  // (the masked extracts avoid the undefined source operand of the unmasked ones)
+  const __m256d z = _mm256_setzero_pd();
+  const __m256d s = _mm256_add_pd(_mm512_mask_extractf64x4_pd(z, 0xF, a, 0), _mm512_mask_extractf64x4_pd(z, 0xF, a, 1));
+  const __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+#include "SmallKernelsImpl.h"
+#undef SK_ATTR
+static bool supported() { return cpuSupports(2); }
+}
+
+#endif
+
+#define SK_VARIANT(ns, name) { name, ns::supported, ns::info, ns::update, ns::predict }
+
+static const SmallKernels skGeneric = SK_VARIANT(sk_generic, "generic");
+#ifdef SK_X86
+static const SmallKernels skSSE2 = SK_VARIANT(sk_sse2, "sse2");
+static const SmallKernels skAVX2 = SK_VARIANT(sk_avx2, "avx2");
+static const SmallKernels skAVX512 = SK_VARIANT(sk_avx512, "avx512");
+static const SmallKernels* const skAll[] = { &skGeneric, &skSSE2, &skAVX2, &skAVX512 };
+#else
+static const SmallKernels* const skAll[] = { &skGeneric };
+#endif
+
+static const SmallKernels* skSelect() {
+#ifdef SK_X86
+  if (skAVX512.supported()) return &skAVX512;
+  if (skAVX2.supported()) return &skAVX2;
+#endif
+  return NULL;
+}
+
+const SmallKernels* smallKernels() {
+  static const SmallKernels* k = skSelect();
+  return k;
+}
+
+int smallKernelsAll(const SmallKernels* const** k) {
+  *k = skAll;
+  return sizeof(skAll) / sizeof(skAll[0]);
+}
@@ -0,0 +1,31 @@
+#ifndef DFM_SMALLKERNELS_H
+#define DFM_SMALLKERNELS_H
+
+// Vectorised counterparts of the kernels in KalmanFixed.h (Kalman filter with a small state dimension
+// N <= SK_LD and diagonal R), with N given at runtime. Vectors have SK_LD elements and matrices are
+// SK_LD x SK_LD (column-major), zero-padded beyond N, so that every column fills whole registers: one
+// with AVX-512, two with AVX2 and four with SSE2. The loadings Ct are SK_LD x n. The variant for the
+// best instruction set of the CPU is selected at runtime, with a portable fallback on other platforms.
+#define SK_LD 8
+
+struct SmallKernels {
+  const char* isa;
+  bool (*supported)();
+  // See KalmanFixed<N>::info(), update() and predict()
+  void (*info)(int N, const double* Ct, const double* rinv, int n, double* G);
+  double (*update)(int N, const double* Ct, const double* rinv, const double* x, int n,
+                   const double* Gfull, double logrfull,
+                   const double* fp, const double* Pp, double* ff, double* Pf);
+  void (*predict)(int N, const double* A, const double* Q, const double* ff, const double* Pf,
+                  double* fp, double* Pp);
+};
+
+// Kernels for the widest supported instruction set, or NULL if the CPU has no AVX2, in which case
+// the compile-time kernels in KalmanFixed.h are faster.
+const SmallKernels* smallKernels();
+
+// All variants compiled into the package, the portable one first, e.g. to check them against each other.
+// Returns the number of variants.
+int smallKernelsAll(const SmallKernels* const** k);
+
+#endif
@@ -0,0 +1,140 @@
+// Kernels of SmallKernels.h, written once in terms of SK_LD-lane column vectors: included by
+// SmallKernels.cpp once per instruction set, inside a namespace defining the vector type vd, its
+// operations (vzero, vload, vstore, vset1, vadd, vmul, vfmadd: a * b + c, vfnmadd: c - a * b and
+// vsum) and the function attribute SK_ATTR. Hence there is no include guard. Columns beyond N of
+// the outputs are left untouched, so the caller keeps them zero.
+
+SK_ATTR static void info(int N, const double* Ct, const double* rinv, int n, double* G) {
+  vd g[SK_LD];
+  for (int j = 0; j < N; ++j) g[j] = vzero();
+  for (int i = 0; i < n; ++i) {
+    const double* c = Ct + i * SK_LD;
+    const vd cv = vload(c);
+    for (int j = 0; j < N; ++j) g[j] = vfmadd(cv, vset1(rinv[i] * c[j]), g[j]);
+  }
+  for (int j = 0; j < N; ++j) vstore(G + j * SK_LD, g[j]);
+}
+
+SK_ATTR static double update(int N, const double* Ct, const double* rinv, const double* x, int n,
+                             const double* Gfull, double logrfull,
+                             const double* fp, const double* Pp, double* ff, double* Pf) {
+
+  const vd fpv = vload(fp);
+  vd b = vzero();
+  double quad = 0, logr = 0;
+  int nobs = 0;
+  for (int i = 0; i < n; ++i) {
+    if (!std::isfinite(x[i])) continue;
+    const vd c = vload(Ct + i * SK_LD);
+    const double e = x[i] - vsum(vmul(c, fpv));
+    const double we = rinv[i] * e;
+    b = vfmadd(c, vset1(we), b);
+    quad += we * e;
+    logr -= std::log(rinv[i]);
+    ++nobs;
+  }
+  if (nobs == 0) {
+    std::memcpy(ff, fp, SK_LD * sizeof(double));
+    std::memcpy(Pf, Pp, SK_LD * SK_LD * sizeof(double));
+    return 0;
+  }
+
+  // Information matrix of the observed series
+  double G[SK_LD * SK_LD];
+  const double* Gp = G;
+  if (nobs == n) {
+    Gp = Gfull;
+    logr = logrfull;
+  } else {
+    vd g[SK_LD];
+    for (int j = 0; j < N; ++j) g[j] = vzero();
+    for (int i = 0; i < n; ++i) {
+      if (!std::isfinite(x[i])) continue;
+      const double* c = Ct + i * SK_LD;
+      const vd cv = vload(c);
+      for (int j = 0; j < N; ++j) g[j] = vfmadd(cv, vset1(rinv[i] * c[j]), g[j]);
+    }
+    for (int j = 0; j < N; ++j) vstore(G + j * SK_LD, g[j]);
+  }
+
+  // M = I + Pp G, then solve M Pf = Pp by Gaussian elimination with partial pivoting,
+  // with the row operations applied to whole columns
+  double M[SK_LD * SK_LD], B[SK_LD * SK_LD], l[SK_LD];
+  vd pp[SK_LD];
+  for (int k = 0; k < N; ++k) pp[k] = vload(Pp + k * SK_LD);
+  for (int j = 0; j < N; ++j) {
+    vd m = vzero();
+    for (int k = 0; k < N; ++k) m = vfmadd(pp[k], vset1(Gp[k + j * SK_LD]), m);
+    vstore(M + j * SK_LD, m);
+    M[j + j * SK_LD] += 1;
+    vstore(B + j * SK_LD, pp[j]);
+  }
+  double det = 1;
+  for (int k = 0; k < N; ++k) {
+    int p = k;
+    double amax = std::abs(M[k + k * SK_LD]);
+    for (int i = k + 1; i < N; ++i)
+      if (std::abs(M[i + k * SK_LD]) > amax) { amax = std::abs(M[i + k * SK_LD]); p = i; }
+    if (amax == 0) {
+      std::memcpy(ff, fp, SK_LD * sizeof(double));
+      std::memcpy(Pf, Pp, SK_LD * SK_LD * sizeof(double));
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (p != k) {
+      for (int j = 0; j < N; ++j) {
+        double tmp = M[k + j * SK_LD]; M[k + j * SK_LD] = M[p + j * SK_LD]; M[p + j * SK_LD] = tmp;
+        tmp = B[k + j * SK_LD]; B[k + j * SK_LD] = B[p + j * SK_LD]; B[p + j * SK_LD] = tmp;
+      }
+      det = -det;
+    }
+    const double piv = M[k + k * SK_LD];
+    det *= piv;
+    for (int i = 0; i < SK_LD; ++i) l[i] = i > k && i < N ? M[i + k * SK_LD] / piv : 0;
+    const vd lv = vload(l);
+    for (int j = k + 1; j < N; ++j)
+      vstore(M + j * SK_LD, vfnmadd(lv, vset1(M[k + j * SK_LD]), vload(M + j * SK_LD)));
+    for (int j = 0; j < N; ++j)
+      vstore(B + j * SK_LD, vfnmadd(lv, vset1(B[k + j * SK_LD]), vload(B + j * SK_LD)));
+  }
+  for (int i = N - 1; i >= 0; --i) {
+    const double d = M[i + i * SK_LD];
+    for (int r = 0; r < SK_LD; ++r) l[r] = r < i ? M[r + i * SK_LD] : 0;
+    const vd uv = vload(l);
+    for (int j = 0; j < N; ++j) {
+      const double bij = B[i + j * SK_LD] /= d;
+      vstore(B + j * SK_LD, vfnmadd(uv, vset1(bij), vload(B + j * SK_LD)));
+    }
+  }
+
+  for (int j = 0; j < SK_LD; ++j)
+    for (int i = 0; i < SK_LD; ++i)
+      Pf[i + j * SK_LD] = i < N && j < N ? 0.5 * (B[i + j * SK_LD] + B[j + i * SK_LD]) : 0;
+  double bb[SK_LD];
+  vstore(bb, b);
+  vd s = vzero();
+  for (int k = 0; k < N; ++k) s = vfmadd(vload(Pf + k * SK_LD), vset1(bb[k]), s);
+  vstore(ff, vadd(fpv, s));
+  quad -= vsum(vmul(b, s));
+  if (det <= 0) return std::numeric_limits<double>::quiet_NaN();
+  return std::log(det) + logr + quad;
+}
+
+SK_ATTR static void predict(int N, const double* A, const double* Q, const double* ff, const double* Pf,
+                            double* fp, double* Pp) {
+  vd a[SK_LD], ap[SK_LD];
+  for (int k = 0; k < N; ++k) a[k] = vload(A + k * SK_LD);
+  vd f = vzero();
+  for (int k = 0; k < N; ++k) f = vfmadd(a[k], vset1(ff[k]), f);
+  vstore(fp, f);
+  // A Pf, then (A Pf) A' + Q
+  for (int j = 0; j < N; ++j) {
+    vd s = vzero();
+    for (int k = 0; k < N; ++k) s = vfmadd(a[k], vset1(Pf[k + j * SK_LD]), s);
+    ap[j] = s;
+  }
+  for (int j = 0; j < N; ++j) {
+    vd s = vload(Q + j * SK_LD);
+    for (int k = 0; k < N; ++k) s = vfmadd(ap[k], vset1(A[j + k * SK_LD]), s);
+    vstore(Pp + j * SK_LD, s);
+  }
+}
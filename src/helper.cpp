@@ -1,6 +1,7 @@
 #include <RcppArmadillo.h>
 #include "helper.h"
 #include <Rcpp.h>
+#include <random>
 
 // [[Rcpp::depends(RcppArmadillo)]]
 
@@ -82,3 +83,39 @@ SEXP apinv(SEXP x) {
   return res;
 }
 
+// Randomized truncated SVD of Halko, Martinsson and Tropp (2011): a Gaussian
+// range finder with 'oversample' extra columns and 'power' re-orthonormalized
+// power iterations, followed by an exact SVD of the small projected matrix.
+void rsvdCore(const arma::mat& X, int k, int oversample, int power, unsigned int seed,
+              arma::colvec& d, arma::mat& U, arma::mat& V) {
+
+  const int l = std::min(k + oversample, int(std::min(X.n_rows, X.n_cols)));
+  std::mt19937_64 rng(seed);
+  std::normal_distribution<double> rnorm(0.0, 1.0);
+  arma::mat Omega(X.n_cols, l), Q, R;
+  Omega.imbue([&]() { return rnorm(rng); });
+
+  arma::qr_econ(Q, R, X * Omega);
+  for (int i = 0; i < power; ++i) {
+    arma::qr_econ(Q, R, X.t() * Q);
+    arma::qr_econ(Q, R, X * Q);
+  }
+
+  arma::mat Ub;
+  arma::svd_econ(Ub, d, V, Q.t() * X);
+  U = Q * Ub.cols(0, k-1);
+  V = V.cols(0, k-1);
+  d = d.head(k);
+}
+
+// [[Rcpp::export]]
+Rcpp::List arsvd(const arma::mat& x, int k, int oversample = 10, int power = 2, int seed = 1) {
+  if (k < 1 || k > int(std::min(x.n_rows, x.n_cols)))
+    Rcpp::stop("k must be between 1 and min(dim(x))");
+  arma::colvec d;
+  arma::mat u, v;
+  rsvdCore(x, k, oversample, power, seed, d, u, v);
+  return Rcpp::List::create(Rcpp::Named("d") = Rcpp::NumericVector(d.begin(), d.end()),
+                            Rcpp::Named("u") = u,
+                            Rcpp::Named("v") = v);
+}
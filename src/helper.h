@@ -2,3 +2,74 @@ arma::cube array2cube(Rcpp::NumericVector myArray);
 arma::field<arma::mat> array2field2mat(Rcpp::NumericVector myArray);
 arma::field<arma::cube> array2field1cube( Rcpp::NumericVector myArray);
 arma::field<arma::cube> array2field2cube(Rcpp::NumericVector myArray);
+void rsvdCore(const arma::mat& X, int k, int oversample, int power, unsigned int seed,
+              arma::colvec& d, arma::mat& U, arma::mat& V);
+
+// Bit-packed missingness masks (raw vectors): column j of a T x n mask occupies bytes
+// [j * maskBytes(T), (j + 1) * maskBytes(T)), and bit t % 8 of byte t / 8 flags cell (t, j)
+inline size_t maskBytes(int T) { return (size_t)(T + 7) / 8; }
+inline bool maskGet(const unsigned char* m, int t) { return (m[t >> 3] >> (t & 7)) & 1; }
+inline void maskSet(unsigned char* m, int t) { m[t >> 3] |= (unsigned char)(1 << (t & 7)); }
+
+// Packed storage of a history of symmetric n x n matrices (e.g. state covariances): column t
+// holds the upper triangle of matrix t in column-major order, n(n+1)/2 elements, halving
+// memory and bandwidth compared to a cube. Matrices are symmetrized exactly when stored.
+// The element type eT only affects storage: matrices are passed in and out in double.
+template <class eT>
+class SymCubeT {
+public:
+  arma::uword n_rows, n_slices;
+  SymCubeT() : n_rows(0), n_slices(0) {}
+  SymCubeT(arma::uword n, arma::uword T) { zeros(n, T); }
+  void zeros(arma::uword n, arma::uword T) {
+    n_rows = n;
+    n_slices = T;
+    mem.zeros(n * (n + 1) / 2, T);
+  }
+  void set(arma::uword t, const arma::mat& P) {
+    eT* p = mem.colptr(t);
+    for (arma::uword j = 0; j < n_rows; ++j)
+      for (arma::uword i = 0; i <= j; ++i) *p++ = eT(0.5 * (P(i, j) + P(j, i)));
+  }
+  // Unpacks matrix t into P, which is only reallocated if it has the wrong size
+  void get(arma::uword t, arma::mat& P) const {
+    P.set_size(n_rows, n_rows);
+    const eT* p = mem.colptr(t);
+    for (arma::uword j = 0; j < n_rows; ++j)
+      for (arma::uword i = 0; i <= j; ++i) P(i, j) = P(j, i) = double(*p++);
+  }
+  arma::mat get(arma::uword t) const {
+    arma::mat P;
+    get(t, P);
+    return P;
+  }
+  arma::cube expand() const {
+    arma::cube C(n_rows, n_rows, n_slices);
+    for (arma::uword t = 0; t < n_slices; ++t) C.slice(t) = get(t);
+    return C;
+  }
+private:
+  arma::Mat<eT> mem;
+};
+typedef SymCubeT<double> SymCube;
+typedef SymCubeT<float> fSymCube;
+
+// Storage policy for covariance histories, so that kernels can be written once for full cubes and packed storage,
+// in double or single precision. Single precision stores are read and written in double (float storage, double arithmetic).
+// getSlice() returns a reference to slice t of a double cube, and otherwise converts it into the buffer buf (reused
+// across calls, so that loops do not allocate) and returns that.
+inline void initSlices(arma::cube& C, arma::uword n, arma::uword T) { C.zeros(n, n, T); }
+inline void initSlices(arma::fcube& C, arma::uword n, arma::uword T) { C.zeros(n, n, T); }
+template <class eT>
+inline void initSlices(SymCubeT<eT>& C, arma::uword n, arma::uword T) { C.zeros(n, T); }
+inline const arma::mat& getSlice(const arma::cube& C, arma::uword t, arma::mat&) { return C.slice(t); }
+inline const arma::mat& getSlice(const arma::fcube& C, arma::uword t, arma::mat& buf) {
+  buf = arma::conv_to<arma::mat>::from(C.slice(t));
+  return buf;
+}
+template <class eT>
+inline const arma::mat& getSlice(const SymCubeT<eT>& C, arma::uword t, arma::mat& buf) { C.get(t, buf); return buf; }
+inline void setSlice(arma::cube& C, arma::uword t, const arma::mat& P) { C.slice(t) = P; }
+inline void setSlice(arma::fcube& C, arma::uword t, const arma::mat& P) { C.slice(t) = arma::conv_to<arma::fmat>::from(P); }
+template <class eT>
+inline void setSlice(SymCubeT<eT>& C, arma::uword t, const arma::mat& P) { C.set(t, P); }